@@ -0,0 +1,78 @@
+#include "Arena.h"
+
+#include <new>
+#include <cstdint>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t hugePageSize = size_t(2) << 20;
+HugePages policy = HugePages::Transparent;
+
+size_t roundUp(size_t value, size_t unit) {
+    return (value + unit - 1) / unit * unit;
+}
+
+void* mapAnonymous(size_t length, int extraFlags) {
+    void* data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+    return data == MAP_FAILED ? nullptr : data;
+}
+
+} // namespace
+
+void setHugePages(HugePages mode) {
+    policy = mode;
+}
+
+HugePages hugePages() {
+    return policy;
+}
+
+void* arenaAllocate(size_t bytes, size_t& length) {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    bytes = std::max<size_t>(bytes, 1);
+
+    // 小于一个大页的区域按普通页分配，不做对齐
+    if (policy == HugePages::None || bytes < hugePageSize) {
+        length = roundUp(bytes, pageSize);
+        void* data = mapAnonymous(length, 0);
+        if (data == nullptr) {
+            throw std::bad_alloc();
+        }
+        return data;
+    }
+
+    length = roundUp(bytes, hugePageSize);
+#ifdef MAP_HUGETLB
+    if (policy == HugePages::Explicit) {
+        void* data = mapAnonymous(length, MAP_HUGETLB);
+        if (data != nullptr) {
+            return data;
+        }
+    }
+#endif
+
+    // 多映射一个大页，再裁掉首尾使起点按 2 MB 对齐
+    char* raw = static_cast<char*>(mapAnonymous(length + hugePageSize, 0));
+    if (raw == nullptr) {
+        throw std::bad_alloc();
+    }
+    char* data = reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(raw), hugePageSize));
+    size_t head = data - raw;
+    if (head > 0) {
+        munmap(raw, head);
+    }
+    size_t tail = hugePageSize - head;
+    if (tail > 0) {
+        munmap(data + length, tail);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(data, length, MADV_HUGEPAGE);
+#endif
+    return data;
+}
+
+void arenaRelease(void* data, size_t length) {
+    munmap(data, length);
+}
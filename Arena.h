@@ -0,0 +1,124 @@
+/*
+ * Arena.h
+ *
+ * Contiguous storage for the panel arrays. Every buffer is a single mmap'ed
+ * region; regions of at least one huge page are aligned to 2 MB so they can
+ * be backed by transparent huge pages (madvise MADV_HUGEPAGE) or, under
+ * HugePages::Explicit, by the hugetlbfs pool (MAP_HUGETLB, falling back to
+ * normal pages when the pool is empty). Fresh regions are zero-filled.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+enum class HugePages { None, Transparent, Explicit };
+
+// Huge-page policy for buffers allocated from now on (default Transparent)
+void setHugePages(HugePages mode);
+HugePages hugePages();
+
+// Returns a zero-filled region of at least bytes bytes and its mapped length;
+// throws std::bad_alloc when the mapping fails.
+void* arenaAllocate(size_t bytes, size_t& length);
+void arenaRelease(void* data, size_t length);
+
+// Fixed-capacity array of trivially copyable T in one arena region. assign()
+// keeps the region when it is large enough, so buffers refilled per batch or
+// per query are allocated once.
+template <typename T>
+class ArenaBuffer {
+private:
+    T* items = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t length = 0;
+
+public:
+    ArenaBuffer() {}
+    ArenaBuffer(const ArenaBuffer&) = delete;
+    ArenaBuffer& operator=(const ArenaBuffer&) = delete;
+    ArenaBuffer(ArenaBuffer&& other) { swap(other); }
+    ArenaBuffer& operator=(ArenaBuffer&& other) {
+        swap(other);
+        return *this;
+    }
+    ~ArenaBuffer() { clear(); }
+
+    void assign(size_t n, T value) {
+        if (n > capacity) {
+            clear();
+            items = static_cast<T*>(arenaAllocate(n * sizeof(T), length));
+            capacity = length / sizeof(T);
+            count = n;
+            if (value != T()) {
+                std::fill(items, items + n, value);
+            }
+            return;
+        }
+        count = n;
+        std::fill(items, items + n, value);
+    }
+
+    void clear() {
+        if (items != nullptr) {
+            arenaRelease(items, length);
+        }
+        items = nullptr;
+        count = capacity = length = 0;
+    }
+
+    void swap(ArenaBuffer& other) {
+        std::swap(items, other.items);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+        std::swap(length, other.length);
+    }
+
+    T* data() { return items; }
+    const T* data() const { return items; }
+    size_t size() const { return count; }
+    size_t bytes() const { return length; }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+};
+
+// Row-major rows x cols matrix in one arena region; m[r] is a pointer to row r.
+template <typename T>
+class Matrix {
+private:
+    ArenaBuffer<T> buffer;
+    size_t rowCount = 0;
+    size_t colCount = 0;
+
+public:
+    void assign(size_t rows, size_t cols, T value = T()) {
+        buffer.assign(rows * cols, value);
+        rowCount = rows;
+        colCount = cols;
+    }
+
+    void clear() {
+        buffer.clear();
+        rowCount = colCount = 0;
+    }
+
+    void swap(Matrix& other) {
+        buffer.swap(other.buffer);
+        std::swap(rowCount, other.rowCount);
+        std::swap(colCount, other.colCount);
+    }
+
+    T* operator[](size_t r) { return buffer.data() + r * colCount; }
+    const T* operator[](size_t r) const { return buffer.data() + r * colCount; }
+    size_t size() const { return rowCount; }
+    size_t cols() const { return colCount; }
+    bool empty() const { return rowCount == 0; }
+    size_t bytes() const { return buffer.bytes(); }
+};
+
+#endif // ARENA_H
@@ -0,0 +1,38 @@
+/*
+ * MatchStarts.h
+ *
+ * Match starts of the haplotypes in one out-panel query's block [f, g),
+ * indexed by haplotype. The sweeps only read the start of a haplotype while it
+ * is in the block; leave() is called once it has been reported.
+ */
+
+#ifndef MATCHSTARTS_H
+#define MATCHSTARTS_H
+
+#include <unordered_map>
+
+// M-entry scratch array shared by the queries of a sweep; stale entries are
+// overwritten when a haplotype joins the block again.
+class PanelStarts {
+private:
+    int* starts;
+
+public:
+    explicit PanelStarts(int* starts_val) : starts(starts_val) {}
+
+    int& operator[](int h) { return starts[h]; }
+    void leave(int) {}
+};
+
+// Starts of the current block only, so a streamed batch holds O(block size)
+// per query instead of M ints.
+class BlockStarts {
+private:
+    std::unordered_map<int, int> starts;
+
+public:
+    int& operator[](int h) { return starts[h]; }
+    void leave(int h) { starts.erase(h); }
+};
+
+#endif // MATCHSTARTS_H
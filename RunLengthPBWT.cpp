@@ -0,0 +1,498 @@
+#include "RunLengthPBWT.h"
+#include "multiPBWT.h"
+
+using namespace std;
+
+int RunLengthPBWT::build(std::istream& in, int M_val, int N_val, int t_val) {
+    M = M_val;
+    N = N_val;
+    t = t_val;
+    try {
+        columns.assign(N, Column());
+        phiCol.assign(M, vector<int>());
+        phiHap.assign(M, vector<int>());
+        phiDiv.assign(M, vector<int>());
+        psiCol.assign(M, vector<int>());
+        psiHap.assign(M, vector<int>());
+        samples.assign(N / sampleInterval + 1, vector<int>());
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败 (压缩索引): " << e.what() << std::endl;
+        return -1;
+    }
+
+    // 仅保留当前列的 array/divergence，逐列构建
+    vector<int> a(M), d(M, 0), na(M), nd(M);
+    std::iota(a.begin(), a.end(), 0);
+    vector<int> count(t), offset(t), p(t);
+    vector<uint8_t> site(M);
+
+    std::string line;
+    int K = 0;
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) != 0) {
+            continue;
+        }
+        if (K >= N) {
+            std::cerr << "SITE行数过多: K=" << K << ", 预期N=" << N << std::endl;
+            return 10;
+        }
+
+        std::stringstream ss(line);
+        std::string token;
+        for (int field = 0; field < 5; field++) {
+            std::getline(ss, token, '\t');
+        }
+        if ((int)token.size() != M) {
+            std::cerr << "单倍型数据长度不匹配: 预期 " << M << ", 实际 " << token.size() << ", K=" << K << std::endl;
+            return 6;
+        }
+
+        recordNeighbours(K, a, d);
+        if (K % sampleInterval == 0) {
+            samples[K / sampleInterval] = a;
+        }
+
+        Column& col = columns[K];
+        fill(count.begin(), count.end(), 0);
+        for (int i = 0; i < M; i++) {
+            int x = token[a[i]] - '0';
+            if (x < 0 || x > 9 || x >= t) {
+                std::cerr << "无效的位点值: '" << token[a[i]] << "' 在 K=" << K << ", index=" << a[i] << std::endl;
+                return 7;
+            }
+            site[i] = x;
+            if (i == 0 || x != site[i - 1]) {
+                if (i > 0) {
+                    col.tail.push_back(a[i - 1]);
+                }
+                col.start.push_back(i);
+                col.allele.push_back(x);
+                col.head.push_back(a[i]);
+                col.rank.insert(col.rank.end(), count.begin(), count.end());
+            }
+            count[x]++;
+        }
+        col.tail.push_back(a[M - 1]);
+        col.start.push_back(M);
+        col.rank.insert(col.rank.end(), count.begin(), count.end());
+
+        int r = col.allele.size();
+        col.alleleOffset.assign(t + 1, 0);
+        for (int ri = 0; ri < r; ri++) {
+            col.alleleOffset[col.allele[ri] + 1]++;
+        }
+        for (int c = 0; c < t; c++) {
+            col.alleleOffset[c + 1] += col.alleleOffset[c];
+        }
+        col.byAllele.resize(r);
+        vector<int> fillPos(col.alleleOffset.begin(), col.alleleOffset.end() - 1);
+        for (int ri = 0; ri < r; ri++) {
+            col.byAllele[fillPos[col.allele[ri]]++] = ri;
+        }
+        col.start.shrink_to_fit();
+        col.allele.shrink_to_fit();
+        col.head.shrink_to_fit();
+        col.tail.shrink_to_fit();
+        col.rank.shrink_to_fit();
+
+        // 与 makePanel 相同的 array/divergence 更新
+        offset[0] = 0;
+        for (int c = 1; c < t; c++) {
+            offset[c] = offset[c - 1] + count[c - 1];
+        }
+        fill(p.begin(), p.end(), K + 1);
+        for (int i = 0; i < M; i++) {
+            for (int c = 0; c < t; c++) {
+                if (d[i] > p[c]) {
+                    p[c] = d[i];
+                }
+            }
+            int x = site[i];
+            na[offset[x]] = a[i];
+            nd[offset[x]] = p[x];
+            offset[x]++;
+            p[x] = 0;
+        }
+        a.swap(na);
+        d.swap(nd);
+        K++;
+    }
+
+    if (K != N) {
+        std::cerr << "处理了 " << K << " 个位点，预期 " << N << std::endl;
+        return 10;
+    }
+    recordNeighbours(N, a, d);
+
+    for (int h = 0; h < M; h++) {
+        phiCol[h].shrink_to_fit();
+        phiHap[h].shrink_to_fit();
+        phiDiv[h].shrink_to_fit();
+        psiCol[h].shrink_to_fit();
+        psiHap[h].shrink_to_fit();
+    }
+    return 0;
+}
+
+void RunLengthPBWT::recordNeighbours(int k, const vector<int>& a, const vector<int>& d) {
+    for (int i = 0; i < M; i++) {
+        int h = a[i];
+        int above = i > 0 ? a[i - 1] : -1;
+        int div = i > 0 ? d[i] : 0;
+        if (phiCol[h].empty() || phiHap[h].back() != above || phiDiv[h].back() != div) {
+            phiCol[h].push_back(k);
+            phiHap[h].push_back(above);
+            phiDiv[h].push_back(div);
+        }
+        int below = i < M - 1 ? a[i + 1] : -1;
+        if (psiCol[h].empty() || psiHap[h].back() != below) {
+            psiCol[h].push_back(k);
+            psiHap[h].push_back(below);
+        }
+    }
+}
+
+int RunLengthPBWT::runAt(int k, int i) const {
+    const vector<int>& start = columns[k].start;
+    return std::upper_bound(start.begin(), start.end(), i) - start.begin() - 1;
+}
+
+int RunLengthPBWT::lastRunBefore(int k, int i, int c) const {
+    const Column& col = columns[k];
+    auto first = col.byAllele.begin() + col.alleleOffset[c];
+    auto last = col.byAllele.begin() + col.alleleOffset[c + 1];
+    auto it = std::lower_bound(first, last, i, [&col](int ri, int value) { return col.start[ri] < value; });
+    return it == first ? -1 : *(it - 1);
+}
+
+int RunLengthPBWT::firstRunFrom(int k, int i, int c) const {
+    const Column& col = columns[k];
+    auto first = col.byAllele.begin() + col.alleleOffset[c];
+    auto last = col.byAllele.begin() + col.alleleOffset[c + 1];
+    auto it = std::lower_bound(first, last, i, [&col](int ri, int value) { return col.start[ri] < value; });
+    return it == last ? -1 : *it;
+}
+
+int RunLengthPBWT::rankOf(int k, int i, int c) const {
+    const Column& col = columns[k];
+    int ri = runAt(k, i);
+    int value = col.rank[ri * t + c];
+    if (ri < (int)col.allele.size() && col.allele[ri] == c) {
+        value += i - col.start[ri];
+    }
+    return value;
+}
+
+int RunLengthPBWT::u(int k, int i, int c) const {
+    // 面板中没有的等位基因排在所有等位基因之后
+    if (c >= t) {
+        return M;
+    }
+    const Column& col = columns[k];
+    const int* total = &col.rank[col.allele.size() * t];
+    int less = 0;
+    for (int _ = 0; _ < c; _++) {
+        less += total[_];
+    }
+    return less + rankOf(k, i, c);
+}
+
+int RunLengthPBWT::pred(int h, int k, int& div) const {
+    const vector<int>& cols = phiCol[h];
+    int idx = std::upper_bound(cols.begin(), cols.end(), k) - cols.begin() - 1;
+    div = phiDiv[h][idx];
+    return phiHap[h][idx];
+}
+
+int RunLengthPBWT::succ(int h, int k) const {
+    const vector<int>& cols = psiCol[h];
+    int idx = std::upper_bound(cols.begin(), cols.end(), k) - cols.begin() - 1;
+    return psiHap[h][idx];
+}
+
+int RunLengthPBWT::stepBack(int k, int& i) const {
+    // array[k] 按位点 k-1 的等位基因分组: i 所在的组即该单倍型在 k-1 处的等位基因，
+    // 组内序号即它在 array[k-1] 中该等位基因的出现序号
+    const Column& col = columns[k - 1];
+    const int* total = &col.rank[col.allele.size() * t];
+    int c = 0, less = 0;
+    while (less + total[c] <= i) {
+        less += total[c];
+        c++;
+    }
+    int j = i - less;
+    auto first = col.byAllele.begin() + col.alleleOffset[c];
+    auto last = col.byAllele.begin() + col.alleleOffset[c + 1];
+    int ri = *(std::upper_bound(first, last, j, [&col, c, this](int value, int run) {
+        return value < col.rank[run * t + c];
+    }) - 1);
+    i = col.start[ri] + j - col.rank[ri * t + c];
+    return c;
+}
+
+int RunLengthPBWT::haplotypeAt(int k, int i) const {
+    for (; k % sampleInterval != 0; k--) {
+        stepBack(k, i);
+    }
+    return samples[k / sampleInterval][i];
+}
+
+int RunLengthPBWT::commonSuffix(const uint8_t* z, int a, int i, bool& before) const {
+    // 从位点 a-1 向前比较，前缀完全相同的单倍型排在查询之后
+    for (int k = a; k > 0; k--) {
+        int c = stepBack(k, i);
+        if (c != z[k - 1]) {
+            before = c < z[k - 1];
+            return a - k;
+        }
+    }
+    before = false;
+    return a;
+}
+
+void RunLengthPBWT::locate(const uint8_t* z, int a, Sweep& sweep) const {
+    // 按反向前缀 [0, a) 二分查找查询在 array[a] 中的插入位置，与 multiPBWT::locateQuery 相同
+    bool before;
+    int lo = 0, hi = M;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        commonSuffix(z, a, mid, before);
+        if (before) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    sweep = Sweep();
+    sweep.fakeLocation = sweep.f = sweep.g = lo;
+    sweep.above = lo > 0 ? haplotypeAt(a, lo - 1) : -1;
+    sweep.below = lo < M ? haplotypeAt(a, lo) : -1;
+    sweep.Zdivergence = lo > 0 ? a - commonSuffix(z, a, lo - 1, before) : a;
+    sweep.belowZdivergence = lo < M ? a - commonSuffix(z, a, lo, before) : a;
+}
+
+size_t RunLengthPBWT::bytes() const {
+    size_t total = 0;
+    for (const Column& col : columns) {
+        total += col.start.capacity() * sizeof(int) + col.allele.capacity() + col.head.capacity() * sizeof(int) +
+                 col.tail.capacity() * sizeof(int) + col.rank.capacity() * sizeof(int) +
+                 col.byAllele.capacity() * sizeof(int) + col.alleleOffset.capacity() * sizeof(int);
+    }
+    for (int h = 0; h < M; h++) {
+        total += (phiCol[h].capacity() + phiHap[h].capacity() + phiDiv[h].capacity() + psiCol[h].capacity() +
+                  psiHap[h].capacity()) * sizeof(int);
+    }
+    for (const vector<int>& sample : samples) {
+        total += sample.capacity() * sizeof(int);
+    }
+    return total;
+}
+
+int RunLengthPBWT::outPanelQuery(const uint8_t* z, int L, int a, int b, int hapB, MatchSink& sink,
+                                 vector<int>& dZ) const {
+    Sweep sweep;
+    PanelStarts starts(dZ.data());
+    if (a > 0) {
+        locate(z, a, sweep);
+    }
+    for (int k = a; k <= b; k++) {
+        advance(sweep, k, z[k], L, a, hapB, sink, starts);
+    }
+    finish(sweep, b, hapB, sink, starts);
+    return 0;
+}
+
+template <typename Starts>
+void RunLengthPBWT::advance(Sweep& sweep, int k, int querySite, int L, int a, int hapB, MatchSink& sink,
+                            Starts& dZ) const {
+    // 查询的虚拟插入位置及上下相邻单倍型，与 multiPBWT::outPanelMatchBatch 相同；
+    // 匹配块 [f, g) 及其首尾单倍型 top/bottom
+    int& fakeLocation = sweep.fakeLocation;
+    int& above = sweep.above;
+    int& below = sweep.below;
+    int& Zdivergence = sweep.Zdivergence;
+    int& belowZdivergence = sweep.belowZdivergence;
+    int& f = sweep.f;
+    int& g = sweep.g;
+    int& top = sweep.top;
+    int& bottom = sweep.bottom;
+
+    const Column& col = columns[k];
+
+    // 位点 a 之前只跟踪查询位置与相邻单倍型 (每位点 O(log r))，不维护匹配块
+
+    if (k == a) {
+        // 位点 a 处已持续至少 L 的匹配组成初始块，真实起点沿 phi/psi 的 divergence 累积
+        int limit = a - L;
+        int matchStart = Zdivergence;
+        for (int index = above; index >= 0 && matchStart <= limit;) {
+            dZ[index] = matchStart;
+            --f;
+            top = index;
+            if (bottom < 0) {
+                bottom = index;
+            }
+            int div;
+            index = pred(index, a, div);
+            matchStart = max(matchStart, div);
+        }
+        matchStart = belowZdivergence;
+        for (int index = below; index >= 0 && matchStart <= limit;) {
+            dZ[index] = matchStart;
+            ++g;
+            bottom = index;
+            if (top < 0) {
+                top = index;
+            }
+            index = succ(index, a);
+            if (index >= 0) {
+                int div;
+                pred(index, a, div);
+                matchStart = max(matchStart, div);
+            }
+        }
+    }
+
+    // 块内等位基因不同的单倍型在此结束匹配，按等位基因、再按位置输出；
+    // 终点为 a-1 的匹配不在区域内
+    if (f != g && k > a) {
+        int firstRun = runAt(k, f);
+        int lastRun = runAt(k, g - 1);
+        for (int i = 0; i < t; i++) {
+            if (i == querySite) {
+                continue;
+            }
+            for (int ri = firstRun; ri <= lastRun; ri++) {
+                if (col.allele[ri] != i) {
+                    continue;
+                }
+                int index = col.start[ri] <= f ? top : col.head[ri];
+                int n = min(col.start[ri + 1], g) - max(col.start[ri], f);
+                for (int j = 0; j < n; j++) {
+                    sink.match(index, hapB, dZ[index], k-1);
+                    dZ.leave(index);
+                    if (j + 1 < n) {
+                        index = succ(index, k);
+                    }
+                }
+            }
+        }
+    }
+
+    int nf = u(k, f, querySite);
+    int ng = u(k, g, querySite);
+    int nTop = -1, nBottom = -1;
+    if (nf != ng) {
+        nTop = col.allele[runAt(k, f)] == querySite ? top : col.head[firstRunFrom(k, f, querySite)];
+        nBottom = col.allele[runAt(k, g - 1)] == querySite ? bottom : col.tail[lastRunBefore(k, g, querySite)];
+    }
+
+    int lower = u(k, 0, querySite);
+    int upper = u(k, M, querySite);
+    int nextLocation = u(k, fakeLocation, querySite);
+    if (nextLocation == lower) {
+        // 上方是更小等位基因组的最后一个单倍型（若存在）
+        Zdivergence = k + 1;
+        above = -1;
+        for (int c = min(querySite, t) - 1; c >= 0 && above < 0; c--) {
+            if (col.alleleOffset[c + 1] > col.alleleOffset[c]) {
+                above = col.tail[col.byAllele[col.alleleOffset[c + 1] - 1]];
+            }
+        }
+    } else if (col.allele[runAt(k, fakeLocation - 1)] != querySite) {
+        int ri = lastRunBefore(k, fakeLocation, querySite);
+        int j = col.start[ri + 1] - 1;
+        int index = above;
+        for (int i = fakeLocation - 1; Zdivergence < k && i > j; --i) {
+            int div;
+            index = pred(index, k, div);
+            Zdivergence = max(Zdivergence, div);
+        }
+        above = col.tail[ri];
+    }
+    if (nextLocation == upper) {
+        belowZdivergence = k + 1;
+        below = -1;
+        for (int c = querySite + 1; c < t && below < 0; c++) {
+            if (col.alleleOffset[c + 1] > col.alleleOffset[c]) {
+                below = col.head[col.byAllele[col.alleleOffset[c]]];
+            }
+        }
+    } else if (col.allele[runAt(k, fakeLocation)] != querySite) {
+        int ri = firstRunFrom(k, fakeLocation, querySite);
+        int j = col.start[ri];
+        int index = below;
+        for (int i = fakeLocation; belowZdivergence < k && i < j; ++i) {
+            int div;
+            index = succ(index, k);
+            pred(index, k, div);
+            belowZdivergence = max(belowZdivergence, div);
+        }
+        below = col.head[ri];
+    }
+    fakeLocation = nextLocation;
+
+    f = nf;
+    g = ng;
+    top = nTop;
+    bottom = nBottom;
+    if (k < a) {
+        return;
+    }
+    int limit = k + 1 - L;
+    if (f == g) {
+        bool extendUp = k + 1 - Zdivergence == L;
+        bool extendDown = k + 1 - belowZdivergence == L;
+        if (extendUp) {
+            --f;
+            dZ[above] = limit;
+        }
+        if (extendDown) {
+            dZ[below] = limit;
+            ++g;
+        }
+        if (f != g) {
+            top = extendUp ? above : below;
+            bottom = extendDown ? below : above;
+        }
+    }
+    if (f != g) {
+        while (true) {
+            int div;
+            int index = pred(top, k + 1, div);
+            if (index < 0 || div > limit) {
+                break;
+            }
+            top = index;
+            --f;
+            dZ[top] = limit;
+        }
+        while (g < M) {
+            int div;
+            int index = succ(bottom, k + 1);
+            pred(index, k + 1, div);
+            if (div > limit) {
+                break;
+            }
+            bottom = index;
+            dZ[bottom] = limit;
+            ++g;
+        }
+    }
+}
+
+template <typename Starts>
+void RunLengthPBWT::finish(const Sweep& sweep, int b, int hapB, MatchSink& sink, Starts& dZ) const {
+    int index = sweep.top;
+    for (int j = sweep.f; j < sweep.g; j++) {
+        sink.match(index, hapB, dZ[index], b);
+        if (j + 1 < sweep.g) {
+            index = succ(index, b + 1);
+        }
+    }
+}
+
+template void RunLengthPBWT::advance(Sweep&, int, int, int, int, int, MatchSink&, PanelStarts&) const;
+template void RunLengthPBWT::advance(Sweep&, int, int, int, int, int, MatchSink&, BlockStarts&) const;
+template void RunLengthPBWT::finish(const Sweep&, int, int, MatchSink&, PanelStarts&) const;
+template void RunLengthPBWT::finish(const Sweep&, int, int, MatchSink&, BlockStarts&) const;
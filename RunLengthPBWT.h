@@ -0,0 +1,104 @@
+/*
+ * RunLengthPBWT.h
+ *
+ * Run-length compressed PBWT index in the style of mu-PBWT / the r-index.
+ * Each column k stores only its allele runs over array[k]: run starts, run
+ * alleles, the haplotypes at run heads and tails (sampled prefix values) and
+ * the rank of every allele at each run start, which gives u(k, i, c) in
+ * O(log r). Neighbours in array[k] and the divergence to the haplotype above
+ * are kept per haplotype as change lists (phi / psi): a haplotype's neighbour
+ * only changes at columns where it heads or ends a run, so the lists hold
+ * O(r) entries per column in total.
+ */
+
+#ifndef RUNLENGTHPBWT_H
+#define RUNLENGTHPBWT_H
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "MatchStarts.h"
+
+class MatchSink;
+
+class RunLengthPBWT {
+private:
+    struct Column {
+        std::vector<int> start;        // r + 1 run starts, start[r] = M
+        std::vector<uint8_t> allele;   // r
+        std::vector<int> head;         // r, array[k][start[i]]
+        std::vector<int> tail;         // r, array[k][start[i + 1] - 1]
+        std::vector<int> rank;         // (r + 1) * t, allele counts before each run start
+        std::vector<int> byAllele;     // r run indices grouped by allele
+        std::vector<int> alleleOffset; // t + 1 offsets into byAllele
+    };
+
+    std::vector<Column> columns;
+    // phi: columns at which the haplotype above h changes, that haplotype
+    // (-1 at the top) and the divergence between the two
+    std::vector<std::vector<int>> phiCol, phiHap, phiDiv;
+    // psi: columns at which the haplotype below h changes (-1 at the bottom)
+    std::vector<std::vector<int>> psiCol, psiHap;
+    // array[k] in full for k = 0, S, 2S, ... (S = sampleInterval); a position
+    // of any column is resolved to its haplotype by stepping back to a sample
+    std::vector<std::vector<int>> samples;
+
+    void recordNeighbours(int k, const std::vector<int>& a, const std::vector<int>& d);
+    int runAt(int k, int i) const;
+    int lastRunBefore(int k, int i, int c) const;
+    int firstRunFrom(int k, int i, int c) const;
+    int rankOf(int k, int i, int c) const;
+    int pred(int h, int k, int& div) const;
+    int succ(int h, int k) const;
+    int stepBack(int k, int& i) const;
+    int haplotypeAt(int k, int i) const;
+    int commonSuffix(const uint8_t* z, int a, int i, bool& before) const;
+
+public:
+    // Sweep state of one query haplotype: its virtual position and
+    // neighbours in array[k], and the match block [f, g) with its first and
+    // last haplotype.
+    struct Sweep {
+        int fakeLocation = 0;
+        int above = -1, below = 0;
+        int Zdivergence = 0, belowZdivergence = 0;
+        int f = 0, g = 0;
+        int top = -1, bottom = -1;
+    };
+
+    static const int sampleInterval = 256;
+
+    int M = 0;
+    int N = 0;
+    int t = 0;
+
+    // Builds the index from SITE lines of a MaCS stream, one column at a time
+    // with O(M) working memory.
+    int build(std::istream& in, int M_val, int N_val, int t_val);
+    int u(int k, int i, int c) const;
+    size_t bytes() const;
+    // L-long matches of one query haplotype z against the panel within sites
+    // [a, b]. The query is placed in array[a] by a binary search over reverse
+    // prefixes read back through the columns, so the cost before a follows the
+    // matches reaching a rather than a itself; the block at a is rebuilt from
+    // the phi/psi lists with true match starts.
+    // A query allele absent from the panel sorts after every allele (u = M),
+    // so the block empties there as in the uncompressed sweep.
+    // dZ is caller scratch of size M and needs no reset between queries.
+    int outPanelQuery(const uint8_t* z, int L, int a, int b, int hapB, MatchSink& sink,
+                      std::vector<int>& dZ) const;
+    // Sweep state of z at site a > 0 (position, neighbours and their divergence)
+    void locate(const uint8_t* z, int a, Sweep& sweep) const;
+    // The same query one site at a time: advance() is called for k = 0..b in
+    // order (or a..b after locate) with the query allele at k, then finish()
+    // reports the block still open at b. Lets a streamed batch advance as each site is read. Starts is
+    // PanelStarts or BlockStarts (see MatchStarts.h).
+    template <typename Starts>
+    void advance(Sweep& sweep, int k, int querySite, int L, int a, int hapB, MatchSink& sink, Starts& dZ) const;
+    template <typename Starts>
+    void finish(const Sweep& sweep, int b, int hapB, MatchSink& sink, Starts& dZ) const;
+};
+
+#endif // RUNLENGTHPBWT_H
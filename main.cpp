@@ -1,4 +1,5 @@
 #include "multiPBWT.h" // 假设 multiPBWT 类定义在此头文件中
+#include <getopt.h>
 
 // 打印帮助信息
 void printHelp(const char* programName) {
@@ -7,12 +8,43 @@ void printHelp(const char* programName) {
               << "  -i <file>  指定输入 MaCS 格式单倍型面板文件 (默认: sites.txt)\n"
               << "  -q <file>  指定面板外查询的 MaCS 格式查询文件 (可选，面板外查询时必须)\n"
               << "  -o <file>  指定输出文件 (默认: <输入面板文件>.out)\n"
-              << "  -l <int>   指定最小匹配长度 (默认: 100)\n"
-              << "  -t <type>  指定查询类型: 'in' (面板内查询) 或 'out' (面板外查询) (默认: in)\n"
+              << "  -l <list>  指定最小匹配长度，可用逗号分隔多个阈值，一次扫描完成并在第5列标注满足的最大阈值 (默认: 100)\n"
+              << "  -t <type>  指定查询类型: 'in' (面板内查询)、'out' (面板外查询) 或 'cross' (合并两个面板的排序做跨面板查询) (默认: in)\n"
+              << "  -r <a,b>   只查询位点区域 [a, b] (从 0 开始，包含两端) 内的匹配 (默认: 全部位点)\n"
+              << "  -c         面板外查询时只构建游程压缩索引 (适用于大规模、高冗余面板)\n"
+              << "  -b <int>   面板外查询时每批读取的查询单倍型数，流式处理查询文件 (默认: 0，一次读入全部)\n"
+              << "  -d         构建索引前删去单态位点并合并相同的单倍型，输出仍为原始位点与单倍型\n"
+              << "  --huge-pages <mode>\n"
+              << "             面板数组的大页策略: none、transparent (透明大页，默认) 或 explicit (hugetlbfs 大页，不足时退回普通页)\n"
+              << "  -s, --targets <list>\n"
+              << "             面板内查询时只报告与所列单倍型 (逗号分隔的编号，从 0 开始) 有关的匹配\n"
               << "  -h         显示此帮助信息\n"
               << "示例:\n"
               << "  面板内查询: " << programName << " -i panel.txt -l 100 -o output.txt -t in\n"
-              << "  面板外查询: " << programName << " -i panel.txt -q query.txt -l 100 -o output.txt -t out\n";
+              << "  面板外查询: " << programName << " -i panel.txt -q query.txt -l 100 -o output.txt -t out\n"
+              << "  跨面板查询: " << programName << " -i panel.txt -q query.txt -l 100 -o output.txt -t cross\n"
+              << "  目标单倍型查询: " << programName << " -i panel.txt -l 100 -o output.txt -t in --targets 0,5,17\n"
+              << "  流式面板外查询: " << programName << " -i panel.txt -q query.txt -l 100 -o output.txt -t out -b 10000\n";
+}
+
+// 将整数列表格式化为逗号分隔的字符串
+std::string joinList(const std::vector<int>& values) {
+    std::string text;
+    for (size_t i = 0; i < values.size(); ++i) {
+        text += (i > 0 ? "," : "") + std::to_string(values[i]);
+    }
+    return text;
+}
+
+// 解析逗号分隔的整数列表
+std::vector<int> parseList(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream ss(text);
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+        values.push_back(std::stoi(value));
+    }
+    return values;
 }
 
 // 验证文件有效性
@@ -49,8 +81,13 @@ int main(int argc, char* argv[]) {
     std::string panel = "sites.txt";      // 默认 MaCS 输入文件
     std::string query;                    // 查询文件（面板外查询时使用）
     std::string outputFile;               // 输出文件动态生成
-    int queryLength = 100;                // 默认最小匹配长度
+    std::vector<int> queryLengths = {100}; // 默认最小匹配长度，可为多个阈值
+    std::vector<int> targets;             // 面板内查询的目标单倍型，空表示全部两两匹配
     std::string queryType = "in";         // 默认查询类型为面板内查询
+    int batchSize = 0;                    // 流式查询批大小，0 表示一次读入全部查询
+    bool compressed = false;              // 是否使用游程压缩索引
+    bool reduce = false;                  // 是否化简面板
+    int regionStart = -1, regionEnd = -1; // 区域查询的位点范围，-1 表示全部位点
 
     // 打印命令行参数（用于调试）
     for (int i = 0; i < argc; ++i) {
@@ -59,8 +96,14 @@ int main(int argc, char* argv[]) {
     std::cerr << "\n";
 
     // 解析命令行参数
+    static const struct option longOptions[] = {
+        {"targets", required_argument, nullptr, 's'},
+        {"huge-pages", required_argument, nullptr, 'P'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
     int opt;
-    while ((opt = getopt(argc, argv, "i:I:q:Q:o:O:l:L:t:T:hH")) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:I:q:Q:o:O:l:L:t:T:b:B:r:R:s:S:cCdDhH", longOptions, nullptr)) != -1) {
         try {
             switch (opt) {
                 case 'i':
@@ -77,16 +120,62 @@ int main(int argc, char* argv[]) {
                     break;
                 case 'l':
                 case 'L':
-                    queryLength = std::stoi(optarg);
+                    queryLengths = parseList(optarg);
+                    break;
+                case 's':
+                case 'S':
+                    targets = parseList(optarg);
+                    if (targets.empty()) {
+                        std::cerr << "错误: 目标单倍型列表不能为空\n";
+                        return 1;
+                    }
                     break;
                 case 't':
                 case 'T':
                     queryType = optarg;
-                    if (queryType != "in" && queryType != "out") {
-                        std::cerr << "错误: 查询类型必须为 'in' 或 'out'\n";
+                    if (queryType != "in" && queryType != "out" && queryType != "cross") {
+                        std::cerr << "错误: 查询类型必须为 'in'、'out' 或 'cross'\n";
+                        return 1;
+                    }
+                    break;
+                case 'b':
+                case 'B':
+                    batchSize = std::stoi(optarg);
+                    break;
+                case 'r':
+                case 'R': {
+                    std::string region = optarg;
+                    size_t comma = region.find(',');
+                    if (comma == std::string::npos) {
+                        std::cerr << "错误: 区域格式应为 <a,b>\n";
                         return 1;
                     }
+                    regionStart = std::stoi(region.substr(0, comma));
+                    regionEnd = std::stoi(region.substr(comma + 1));
+                    break;
+                }
+                case 'c':
+                case 'C':
+                    compressed = true;
                     break;
+                case 'd':
+                case 'D':
+                    reduce = true;
+                    break;
+                case 'P': {
+                    std::string mode = optarg;
+                    if (mode == "none") {
+                        setHugePages(HugePages::None);
+                    } else if (mode == "transparent") {
+                        setHugePages(HugePages::Transparent);
+                    } else if (mode == "explicit") {
+                        setHugePages(HugePages::Explicit);
+                    } else {
+                        std::cerr << "错误: 大页策略必须为 'none'、'transparent' 或 'explicit'\n";
+                        return 1;
+                    }
+                    break;
+                }
                 case 'h':
                 case 'H':
                     printHelp(argv[0]);
@@ -107,15 +196,44 @@ int main(int argc, char* argv[]) {
     }
 
     // 验证参数
-    if (panel.empty() || queryLength <= 0) {
+    if (panel.empty() || queryLengths.empty() ||
+        *std::min_element(queryLengths.begin(), queryLengths.end()) <= 0) {
         std::cerr << "错误: 输入面板文件和查询长度必须有效\n";
         return 1;
     }
-    if (queryType == "out" && query.empty()) {
+    if (batchSize < 0) {
+        std::cerr << "错误: 批大小不能为负数\n";
+        return 1;
+    }
+    if (queryType != "in" && query.empty()) {
         std::cerr << "错误: 面板外查询必须提供查询文件 (-q)\n";
         return 1;
     }
-    if (!validateFiles(panel, query, outputFile, queryType == "out")) {
+    if (queryType == "cross" && (batchSize > 0 || regionStart != -1 || compressed || reduce)) {
+        std::cerr << "错误: 跨面板查询 (-t cross) 不能与 -b、-r、-c、-d 同时使用\n";
+        return 1;
+    }
+    if (regionStart != -1 && (regionStart < 0 || regionEnd < regionStart)) {
+        std::cerr << "错误: 区域必须满足 0 <= a <= b\n";
+        return 1;
+    }
+    if (regionStart != -1 && batchSize > 0) {
+        std::cerr << "错误: 区域查询 (-r) 暂不支持流式查询 (-b)\n";
+        return 1;
+    }
+    if (compressed && queryType != "out") {
+        std::cerr << "错误: 压缩索引 (-c) 仅支持面板外查询\n";
+        return 1;
+    }
+    if (!targets.empty() && (queryType != "in" || regionStart != -1)) {
+        std::cerr << "错误: 目标单倍型 (--targets) 仅支持全部位点的面板内查询\n";
+        return 1;
+    }
+    if (reduce && (compressed || batchSize > 0 || regionStart != -1)) {
+        std::cerr << "错误: 面板化简 (-d) 不能与 -c、-b、-r 同时使用\n";
+        return 1;
+    }
+    if (!validateFiles(panel, query, outputFile, queryType != "in")) {
         return 1;
     }
 
@@ -124,33 +242,75 @@ int main(int argc, char* argv[]) {
               << "输入面板文件: " << panel << "\n"
               << "查询文件: " << (query.empty() ? "无（面板内查询）" : query) << "\n"
               << "输出文件: " << outputFile << "\n"
-              << "查询长度: " << queryLength << "\n"
-              << "查询类型: " << (queryType == "in" ? "面板内查询" : "面板外查询") << "\n";
+              << "查询长度: " << joinList(queryLengths) << "\n"
+              << "查询类型: " << (queryType == "in" ? "面板内查询" : (queryType == "out" ? "面板外查询" : "跨面板查询")) << "\n";
+    if (compressed) {
+        std::cout << "索引: 游程压缩\n";
+    }
+    if (reduce) {
+        std::cout << "面板化简: 是\n";
+    }
+    if (!targets.empty()) {
+        std::cout << "目标单倍型: " << joinList(targets) << "\n";
+    }
+    if (regionStart != -1) {
+        std::cout << "查询区域: [" << regionStart << ", " << regionEnd << "]\n";
+    }
+    if (queryType == "out" && batchSize > 0) {
+        std::cout << "查询批大小: " << batchSize << "\n";
+    }
 
     // 创建 PBWT 处理器
     multiPBWT haplotypeMatcher;
-    int a = haplotypeMatcher.readMacsPanel(panel);
+    int a = compressed ? haplotypeMatcher.readMacsPanelCompressed(panel) : haplotypeMatcher.readMacsPanel(panel);
     std::cout << "读取面板: " << a << "\n";
     if (a != 0) return a;
 
-    // 读取查询文件（仅面板外查询）
-    if (queryType == "out") {
+    // 读取查询文件（仅面板外查询，流式查询在查询阶段分批读取）
+    if (queryType != "in" && batchSize == 0) {
         int d = haplotypeMatcher.readMacsQuery(query);
         std::cout << "读取查询文件: " << d << "\n";
         if (d != 0) return d;
     }
 
-    int b = haplotypeMatcher.makePanel();
-    std::cout << "生成面板: " << b << "\n";
-    if (b != 0) return b;
+    // 化简需在读入查询之后进行，查询中出现的多态位点也需保留
+    if (reduce) {
+        int r = haplotypeMatcher.reducePanel();
+        std::cout << "化简面板: " << r << "\n";
+        if (r != 0) return r;
+    }
+
+    // 压缩索引在读取面板时已构建，跨面板查询直接扫描单倍型，不需要面板索引
+    if (!compressed && queryType != "cross") {
+        int b = haplotypeMatcher.makePanel();
+        std::cout << "生成面板: " << b << "\n";
+        if (b != 0) return b;
+    }
 
     // 根据查询类型执行查询
     int c;
-    if (queryType == "in") {
-        c = haplotypeMatcher.inPanelLongMatchQuery(queryLength, outputFile);
+    if (regionStart != -1) {
+        if (queryType == "in") {
+            c = haplotypeMatcher.inPanelRegionQuery(queryLengths, regionStart, regionEnd, outputFile);
+            std::cout << "面板内查询完成: " << c << "\n";
+        } else {
+            c = haplotypeMatcher.outPanelRegionQuery(queryLengths, regionStart, regionEnd, outputFile);
+            std::cout << "面板外查询完成: " << c << "\n";
+        }
+    } else if (queryType == "cross") {
+        c = haplotypeMatcher.crossPanelLongMatchQuery(queryLengths, outputFile);
+        std::cout << "跨面板查询完成: " << c << "\n";
+    } else if (queryType == "in" && !targets.empty()) {
+        c = haplotypeMatcher.inPanelTargetQuery(targets, queryLengths, outputFile);
         std::cout << "面板内查询完成: " << c << "\n";
+    } else if (queryType == "in") {
+        c = haplotypeMatcher.inPanelLongMatchQuery(queryLengths, outputFile);
+        std::cout << "面板内查询完成: " << c << "\n";
+    } else if (batchSize > 0) {
+        c = haplotypeMatcher.outPanelLongMatchQueryStream(queryLengths, query, batchSize, outputFile);
+        std::cout << "面板外查询完成: " << c << "\n";
     } else {
-        c = haplotypeMatcher.outPanelLongMatchQuery(queryLength, outputFile);
+        c = haplotypeMatcher.outPanelLongMatchQuery(queryLengths, outputFile);
         std::cout << "面板外查询完成: " << c << "\n";
     }
     return c;
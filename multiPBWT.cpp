@@ -0,0 +1,1507 @@
+#include "multiPBWT.h"
+
+using namespace std;
+
+int multiPBWT::readMacsPanel(string panel_file) {
+    clock_t start, end;
+    start = clock();
+    std::ifstream in(panel_file);
+    if (in.fail()) {
+        std::cerr << "无法打开文件: " << panel_file << std::endl;
+        return 1;
+    }
+
+    std::string line;
+
+    // Step 1: 计算单倍型数 (M)
+    M = 0;
+    maxSite = 0;
+    bool found_site = false;
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) == 0) {
+            found_site = true;
+            std::stringstream ss(line);
+            std::string token;
+            std::vector<std::string> tokens;
+            while (std::getline(ss, token, '\t')) {
+                tokens.push_back(token);
+            }
+            if (tokens.size() < 5) {
+                std::cerr << "SITE行格式错误: 需要至少5个字段，实际为 " << tokens.size() << std::endl;
+                return 2;
+            }
+            M = tokens[4].size();
+            break;
+        }
+    }
+    if (!found_site) {
+        std::cerr << "未找到SITE行" << std::endl;
+        return 2;
+    }
+    if (M < 1) {
+        std::cerr << "无效的M: " << M << std::endl;
+        return 3;
+    }
+    std::cerr << "M = " << M << std::endl;
+
+    // Step 2: 设置IDs
+    IDs.resize(M);
+    for (int i = 0; i < M; i++) {
+        IDs[i] = std::to_string(i);
+    }
+
+    // Step 3: 计算位点数 (N)
+    N = 0;
+    in.clear();
+    in.seekg(0);
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) == 0) {
+            N++;
+        }
+    }
+    if (N < 1) {
+        std::cerr << "无效的N: " << N << std::endl;
+        return 4;
+    }
+
+    // Step 4: 初始化数据结构
+    try {
+        X.assign(M, N);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败: " << e.what() << std::endl;
+        return -1;
+    }
+
+    // Step 5: 处理SITE行
+    in.clear();
+    in.seekg(0);
+
+    int K = 0;
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) != 0) {
+            continue;
+        }
+
+        if (K >= N) {
+            std::cerr << "SITE行数过多: K=" << K << ", 预期N=" << N << std::endl;
+            return 10;
+        }
+
+        std::stringstream ss(line);
+        std::string token;
+        std::getline(ss, token, '\t'); // Skip "SITE:"
+        std::getline(ss, token, '\t'); // Skip index
+        std::getline(ss, token, '\t'); // Skip physLoc
+        std::getline(ss, token, '\t'); // Skip other column
+        std::getline(ss, token, '\t'); // Get haplotype data
+
+        if (token.size() != M) {
+            std::cerr << "单倍型数据长度不匹配: 预期 " << M << ", 实际 " << token.size() << ", K=" << K << std::endl;
+            return 6;
+        }
+
+        int index = 0;
+        for (char c : token) {
+            if (index >= M) {
+                std::cerr << "索引越界: index=" << index << ", M=" << M << ", K=" << K << std::endl;
+                return 9;
+            }
+            int site = c - '0';
+            if (site < 0 || site > 9) {
+                std::cerr << "无效的位点值: '" << c << "' 在 K=" << K << ", index=" << index << std::endl;
+                return 7;
+            }
+            if (site > maxSite) {
+                maxSite = site;
+            }
+            X[index][K] = site;
+            index++;
+        }
+        if (index != M) {
+            std::cerr << "处理了 " << index << " 个单倍型，预期 " << M << ", K=" << K << std::endl;
+            return 9;
+        }
+
+        K++;
+    }
+
+    if (K != N) {
+        std::cerr << "处理了 " << K << " 个位点，预期 " << N << std::endl;
+        return 10;
+    }
+    int status = buildAlleleDictionary();
+    if (status != 0) {
+        return status;
+    }
+
+    end = clock();
+    readPaneltime = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+    return 0;
+}
+
+int multiPBWT::loadPanel(const uint8_t* haplotypes, int M_val, int N_val) {
+    clock_t start, end;
+    start = clock();
+
+    if (M_val < 1) {
+        std::cerr << "无效的M: " << M_val << std::endl;
+        return 3;
+    }
+    if (N_val < 1) {
+        std::cerr << "无效的N: " << N_val << std::endl;
+        return 4;
+    }
+    M = M_val;
+    N = N_val;
+
+    IDs.resize(M);
+    for (int i = 0; i < M; i++) {
+        IDs[i] = std::to_string(i);
+    }
+
+    try {
+        X.assign(M, N);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败: " << e.what() << std::endl;
+        return -1;
+    }
+
+    // 缓冲区按单倍型优先存放: haplotypes[i * N + k] 为单倍型 i 在位点 k 的等位基因
+    maxSite = 0;
+    for (int i = 0; i < M; i++) {
+        const uint8_t* row = haplotypes + (size_t)i * N;
+        for (int k = 0; k < N; k++) {
+            if (row[k] > 9) {
+                std::cerr << "无效的位点值: " << (int)row[k] << " 在 K=" << k << ", index=" << i << std::endl;
+                return 7;
+            }
+            if (row[k] > maxSite) {
+                maxSite = row[k];
+            }
+            X[i][k] = row[k];
+        }
+    }
+    int status = buildAlleleDictionary();
+    if (status != 0) {
+        return status;
+    }
+
+    end = clock();
+    readPaneltime = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+    return 0;
+}
+
+int multiPBWT::buildAlleleDictionary() {
+    haplotypeGroups.clear();
+    // 逐位点建立等位基因字典: 按符号排序的稠密编码及各编码在 array[k+1] 中的起点，
+    // u 的宽度按本位点实际的等位基因数而不是全局最大值
+    vector<int> width(N);
+    try {
+        alleleRank.assign((size_t)N * 11, 0);
+        alleleOffset.assign(N + 1, 0);
+        alleleStart.clear();
+        t = 1;
+        for (int k = 0; k < N; k++) {
+            int count[10] = {0};
+            for (int i = 0; i < M; i++) {
+                count[X[i][k]]++;
+            }
+            uint8_t* rank = &alleleRank[(size_t)k * 11];
+            int tk = 0, first = 0;
+            for (int s = 0; s < 10; s++) {
+                rank[s] = tk;
+                if (count[s] > 0) {
+                    alleleStart.push_back(first);
+                    first += count[s];
+                    tk++;
+                }
+            }
+            rank[10] = tk;
+            alleleOffset[k + 1] = alleleStart.size();
+            width[k] = tk == 1 ? 0 : (tk == 2 ? 1 : tk);
+            t = max(t, tk);
+        }
+        siteIndex.resize(N + 1);
+        std::iota(siteIndex.begin(), siteIndex.end(), 0);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败: " << e.what() << std::endl;
+        return -1;
+    }
+    uWidth.swap(width);
+    return 0;
+}
+
+int multiPBWT::allocateIndex() {
+    try {
+        array.assign(N + 1, M);
+        std::iota(array[0], array[0] + M, 0);
+        divergence.assign(N + 1, M, 0);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败: " << e.what() << std::endl;
+        return -1;
+    }
+    delete u;
+    u = nullptr;
+    try {
+        u = new UArray(uWidth, M);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败 (u 数组): " << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int multiPBWT::readMacsPanelCompressed(string panel_file) {
+    clock_t start, end;
+    start = clock();
+    std::ifstream in(panel_file);
+    if (in.fail()) {
+        std::cerr << "无法打开文件: " << panel_file << std::endl;
+        return 1;
+    }
+
+    // Step 1: 计算 M、N 和最大等位基因，不保留 X
+    std::string line;
+    M = 0;
+    N = 0;
+    maxSite = 0;
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) != 0) {
+            continue;
+        }
+        std::stringstream ss(line);
+        std::string token;
+        std::vector<std::string> tokens;
+        while (std::getline(ss, token, '\t')) {
+            tokens.push_back(token);
+        }
+        if (tokens.size() < 5) {
+            std::cerr << "SITE行格式错误: 需要至少5个字段，实际为 " << tokens.size() << std::endl;
+            return 2;
+        }
+        if (N == 0) {
+            M = tokens[4].size();
+            if (M < 1) {
+                std::cerr << "无效的M: " << M << std::endl;
+                return 3;
+            }
+        }
+        int index = 0;
+        for (char c : tokens[4]) {
+            int site = c - '0';
+            if (site < 0 || site > 9) {
+                std::cerr << "无效的位点值: '" << c << "' 在 K=" << N << ", index=" << index << std::endl;
+                return 7;
+            }
+            if (site > maxSite) {
+                maxSite = site;
+            }
+            index++;
+        }
+        N++;
+    }
+    if (N < 1) {
+        std::cerr << "未找到SITE行" << std::endl;
+        return 2;
+    }
+    std::cerr << "M = " << M << std::endl;
+    t = maxSite + 1;
+
+    IDs.resize(M);
+    for (int i = 0; i < M; i++) {
+        IDs[i] = std::to_string(i);
+    }
+
+    // Step 2: 逐列构建压缩索引
+    in.clear();
+    in.seekg(0);
+    siteIndex.resize(N + 1);
+    std::iota(siteIndex.begin(), siteIndex.end(), 0);
+    haplotypeGroups.clear();
+    delete rl;
+    rl = new RunLengthPBWT();
+    int status = rl->build(in, M, N, t);
+    if (status != 0) {
+        return status;
+    }
+    std::cerr << "压缩索引大小: " << rl->bytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    end = clock();
+    readPaneltime = makePanelTime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    return 0;
+}
+
+int multiPBWT::readMacsQuery(string txt_file) {
+    clock_t start, end;
+    start = clock();
+
+    std::ifstream in(txt_file);
+    if (in.fail()) {
+        std::cerr << "无法打开查询文件: " << txt_file << std::endl;
+        return 1;
+    }
+
+    std::string line;
+
+    // Step 1: 计算查询单倍型数 (Q)
+    Q = 0;
+    bool found_site = false;
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) == 0) {
+            found_site = true;
+            std::stringstream ss(line);
+            std::string token;
+            std::vector<std::string> tokens;
+            while (std::getline(ss, token, '\t')) {
+                tokens.push_back(token);
+            }
+            if (tokens.size() < 5) {
+                std::cerr << "SITE行格式错误: 需要至少5个字段，实际为 " << tokens.size() << std::endl;
+                return 2;
+            }
+            Q = tokens[4].size();
+            break;
+        }
+    }
+    if (!found_site) {
+        std::cerr << "未找到SITE行" << std::endl;
+        return 2;
+    }
+    if (Q < 1) {
+        std::cerr << "无效的Q: " << Q << std::endl;
+        return 3;
+    }
+    std::cerr << "Q = " << Q << std::endl;
+
+    // Step 2: 设置查询 IDs
+    qIDs.resize(Q);
+    for (int i = 0; i < Q; i++) {
+        qIDs[i] = std::to_string(i);
+    }
+
+    // Step 3: 计算位点数并验证
+    int query_N = 0;
+    in.clear();
+    in.seekg(0);
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) == 0) {
+            query_N++;
+        }
+    }
+    if (query_N < 1) {
+        std::cerr << "无效的查询位点数: " << query_N << std::endl;
+        return 4;
+    }
+    if (N > 0 && query_N != N) {
+        std::cerr << "查询位点数 " << query_N << " 与面板位点数 " << N << " 不匹配" << std::endl;
+        return 5;
+    }
+    if (N == 0) {
+        N = query_N; // 若未调用 readMacsPanel，设置 N
+    }
+
+    // Step 4: 初始化数据结构
+    try {
+        Z.assign(Q, N);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败: " << e.what() << std::endl;
+        return -1;
+    }
+
+    // Step 5: 处理 SITE 行
+    in.clear();
+    in.seekg(0);
+    int K = 0;
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) != 0) {
+            continue;
+        }
+
+        if (K >= N) {
+            std::cerr << "SITE行数过多: K=" << K << ", 预期N=" << N << std::endl;
+            return 10;
+        }
+
+        std::stringstream ss(line);
+        std::string token;
+        std::getline(ss, token, '\t'); // Skip "SITE:"
+        std::getline(ss, token, '\t'); // Skip index
+        std::getline(ss, token, '\t'); // Skip physLoc
+        std::getline(ss, token, '\t'); // Skip other column
+        std::getline(ss, token, '\t'); // Get haplotype data
+
+        if (token.size() != Q) {
+            std::cerr << "查询单倍型数据长度不匹配: 预期 " << Q << ", 实际 " << token.size() << ", K=" << K << std::endl;
+            return 6;
+        }
+
+        int index = 0;
+        for (char c : token) {
+            if (index >= Q) {
+                std::cerr << "索引越界: index=" << index << ", Q=" << Q << ", K=" << K << std::endl;
+                return 9;
+            }
+            int site = c - '0';
+            if (site < 0 || site > 9) {
+                std::cerr << "无效的位点值: '" << c << "' 在 K=" << K << ", index=" << index << std::endl;
+                return 7;
+            }
+            Z[index][K] = site;
+            index++;
+        }
+        if (index != Q) {
+            std::cerr << "处理了 " << index << " 个查询单倍型，预期 " << Q << ", K=" << K << std::endl;
+            return 9;
+        }
+
+        K++;
+    }
+
+    if (K != N) {
+        std::cerr << "处理了 " << K << " 个位点，预期 " << N << std::endl;
+        return 10;
+    }
+
+    end = clock();
+    readQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+    in.close();
+    return 0;
+}
+
+int multiPBWT::loadQuery(const uint8_t* haplotypes, int Q_val, int N_val) {
+    clock_t start, end;
+    start = clock();
+
+    if (Q_val < 1) {
+        std::cerr << "无效的Q: " << Q_val << std::endl;
+        return 3;
+    }
+    if (N_val < 1) {
+        std::cerr << "无效的查询位点数: " << N_val << std::endl;
+        return 4;
+    }
+    if (N > 0 && N_val != N) {
+        std::cerr << "查询位点数 " << N_val << " 与面板位点数 " << N << " 不匹配" << std::endl;
+        return 5;
+    }
+    if (N == 0) {
+        N = N_val;
+    }
+    Q = Q_val;
+
+    qIDs.resize(Q);
+    for (int i = 0; i < Q; i++) {
+        qIDs[i] = std::to_string(i);
+    }
+
+    try {
+        Z.assign(Q, N);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败: " << e.what() << std::endl;
+        return -1;
+    }
+
+    // 与 loadPanel 相同的单倍型优先布局
+    for (int q = 0; q < Q; q++) {
+        const uint8_t* row = haplotypes + (size_t)q * N;
+        for (int k = 0; k < N; k++) {
+            if (row[k] > 9) {
+                std::cerr << "无效的位点值: " << (int)row[k] << " 在 K=" << k << ", index=" << q << std::endl;
+                return 7;
+            }
+            Z[q][k] = row[k];
+        }
+    }
+
+    end = clock();
+    readQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
+
+    return 0;
+}
+
+bool multiPBWT::isReduced() const {
+    return !haplotypeGroups.empty() || siteIndex[N] != N;
+}
+
+int multiPBWT::reducePanel() {
+    if (rl != nullptr) {
+        std::cerr << "压缩索引不支持面板化简" << std::endl;
+        return 3;
+    }
+    if (isReduced()) {
+        std::cerr << "面板已化简" << std::endl;
+        return 4;
+    }
+
+    // Step 1: 保留在面板或已读入的查询中至少有两种等位基因的位点；首尾位点总是保留，
+    // 使延伸到两端的匹配仍在扫描的第一列与最后一列上报告
+    vector<int> kept;
+    for (int k = 0; k < N; k++) {
+        uint8_t site = X[0][k];
+        bool polymorphic = false;
+        for (int i = 1; i < M && !polymorphic; i++) {
+            polymorphic = X[i][k] != site;
+        }
+        for (int q = 0; q < (int)Z.size() && !polymorphic; q++) {
+            polymorphic = Z[q][k] != site;
+        }
+        if (polymorphic || k == 0 || k == N - 1) {
+            kept.push_back(k);
+        }
+    }
+
+    // Step 2: 相同的单倍型合为一组，组内与组间均按原始编号排序，组内最小编号作代表
+    vector<int> order(M);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [this](int i, int j) { return memcmp(X[i], X[j], N) < 0; });
+    vector<vector<int>> groups;
+    for (int i = 0; i < M; i++) {
+        if (i == 0 || memcmp(X[order[i]], X[order[i - 1]], N) != 0) {
+            groups.emplace_back();
+        }
+        groups.back().push_back(order[i]);
+    }
+    std::sort(groups.begin(), groups.end());
+
+    // Step 3: 用化简后的位点与代表单倍型重建 X、Z
+    int originalN = N;
+    try {
+        Matrix<uint8_t> reducedX, reducedZ;
+        reducedX.assign(groups.size(), kept.size());
+        maxSite = 0;
+        for (size_t i = 0; i < groups.size(); i++) {
+            const uint8_t* x = X[groups[i][0]];
+            for (size_t k = 0; k < kept.size(); k++) {
+                reducedX[i][k] = x[kept[k]];
+                if (reducedX[i][k] > maxSite) {
+                    maxSite = reducedX[i][k];
+                }
+            }
+        }
+        X.swap(reducedX);
+        reducedZ.assign(Z.size(), kept.size());
+        for (size_t q = 0; q < Z.size(); q++) {
+            for (size_t k = 0; k < kept.size(); k++) {
+                reducedZ[q][k] = Z[q][kept[k]];
+            }
+        }
+        Z.swap(reducedZ);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败: " << e.what() << std::endl;
+        return -1;
+    }
+    M = groups.size();
+    N = kept.size();
+    int status = buildAlleleDictionary();
+    if (status != 0) {
+        return status;
+    }
+    siteIndex = kept;
+    siteIndex.push_back(originalN);
+    if (M != (int)IDs.size()) {
+        haplotypeGroups.swap(groups);
+    }
+    std::cerr << "化简面板: M = " << M << ", N = " << N << std::endl;
+    return 0;
+}
+
+int multiPBWT::makePanel() {
+    clock_t start, end;
+    start = clock();
+
+    // 面板索引在此才分配，只做跨面板查询时不占用 array/divergence/u
+    int status = allocateIndex();
+    if (status != 0) {
+        return status;
+    }
+
+    // 各等位基因在 array[k+1] 中的起点由字典给出，单倍型直接写入目标位置，不再按等位基因暂存
+    int next[10];
+    int p[10];
+    for (int k = 0; k < N; k++) {
+        // 等位基因按本位点的稠密编码处理; 单态位点只需复制排序，双等位位点只记录编码 0 的 u
+        const uint8_t* rank = &alleleRank[(size_t)k * 11];
+        int tk = rank[10];
+        if (tk == 1) {
+            std::copy(array[k], array[k] + M, array[k + 1]);
+            std::copy(divergence[k], divergence[k] + M, divergence[k + 1]);
+            divergence[k + 1][0] = siteIndex[k] + 1;
+            continue;
+        }
+        int stored = tk == 2 ? 1 : tk;
+        const int* starts = &alleleStart[alleleOffset[k]];
+        for (int _ = 0; _ < tk; _++) {
+            p[_] = siteIndex[k] + 1;
+            next[_] = starts[_];
+        }
+
+        for (int i = 0; i < M; i++) {
+            for (int _ = 0; _ < stored; _++) {
+                (*u)(k, i, _) = next[_];
+            }
+            for (int _ = 0; _ < tk; _++) {
+                if (divergence[k][i] > p[_]) {
+                    p[_] = divergence[k][i];
+                }
+            }
+            int index = array[k][i];
+            int site = rank[X[index][k]];
+
+            array[k + 1][next[site]] = index;
+            divergence[k + 1][next[site]] = p[site];
+            next[site]++;
+            p[site] = 0;
+        }
+        if (next[tk - 1] != M) {
+            return 4;
+        }
+    }
+    end = clock();
+    makePanelTime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    return 0;
+}
+
+int multiPBWT::inPanelLongMatchQuery(int L, string inPanelOutput_file) {
+    return inPanelSweep(vector<int>{L}, 0, N - 1, true, inPanelOutput_file);
+}
+
+int multiPBWT::inPanelLongMatchQuery(const vector<int>& Ls, string inPanelOutput_file) {
+    return inPanelSweep(Ls, 0, N - 1, true, inPanelOutput_file);
+}
+
+int multiPBWT::inPanelLongMatchQuery(int L, MatchSink& sink) {
+    return inPanelSweep(L, 0, N - 1, true, sink);
+}
+
+int multiPBWT::inPanelRegionQuery(int L, int a, int b, string inPanelOutput_file) {
+    return inPanelSweep(vector<int>{L}, a, b, false, inPanelOutput_file);
+}
+
+int multiPBWT::inPanelRegionQuery(const vector<int>& Ls, int a, int b, string inPanelOutput_file) {
+    return inPanelSweep(Ls, a, b, false, inPanelOutput_file);
+}
+
+int multiPBWT::inPanelRegionQuery(int L, int a, int b, MatchSink& sink) {
+    return inPanelSweep(L, a, b, false, sink);
+}
+
+int multiPBWT::inPanelSweep(const vector<int>& Ls, int a, int b, bool wholePanel, string inPanelOutput_file) {
+    vector<int> thresholds;
+    if (!sortThresholds(Ls, thresholds))
+        return 3;
+
+    ofstream out(inPanelOutput_file);
+    if (out.fail())
+        return 2;
+
+    // 以最小阈值扫描一次，每个匹配按其长度归入满足的最大阈值
+    StreamMatchSink sink(out, IDs, IDs);
+    sink.setThresholds(thresholds, siteIndex[b + 1] - 1);
+    int status = inPanelSweep(thresholds[0], a, b, wholePanel, sink);
+
+    out.close();
+    cout << "matches has been put into " << inPanelOutput_file << endl;
+    return status;
+}
+
+int multiPBWT::inPanelSweep(int L, int a, int b, bool wholePanel, MatchSink& output) {
+    clock_t start, end;
+    start = clock();
+
+    // 化简后的面板上报告的是代表单倍型，经 ExpandingMatchSink 展开为原始单倍型
+    ExpandingMatchSink expanded(output, haplotypeGroups, true);
+    MatchSink& sink = haplotypeGroups.empty() ? output : expanded;
+
+    if (rl != nullptr) {
+        std::cerr << "压缩索引不支持面板内查询" << std::endl;
+        return 3;
+    }
+    if (a < 0 || a > b || b >= N) {
+        std::cerr << "无效的区域: [" << a << ", " << b << "], N=" << N << std::endl;
+        return 4;
+    }
+
+    // 从 array[a]/divergence[a] 开始扫描，divergence 即匹配的真实起点；
+    // 在位点 a 处结束的匹配 (终点 a-1) 不在区域内。化简后的面板上 divergence 为原始位点，
+    // 位点 k 经 siteIndex 换算
+    int k;
+    for (k = a + 1; k < b; k++) {
+        // 单态位点上不会有匹配结束；其余位点只需知道块内是否出现了不同的等位基因
+        if (alleleCount(k) == 1) {
+            continue;
+        }
+        int blockSite = -1;
+        int top = 0;
+        bool report = false;
+        for (int i = 0; i < M; i++) {
+            if (divergence[k][i] > siteIndex[k] - L) {
+                if (report == true) {
+                    for (int i_a = top; i_a < i - 1; i_a++) {
+                        int maxDivergence = 0;
+                        for (int i_b = i_a + 1; i_b < i; i_b++) {
+                            if (divergence[k][i_b] > maxDivergence) {
+                                maxDivergence = divergence[k][i_b];
+                            }
+                            uint32_t temp1, temp2, fuzzy1, fuzzy2;
+                            int index_a = array[k][i_a], index_b = array[k][i_b];
+                            int site1 = X[index_a][k];
+                            int site2 = X[index_b][k];
+
+                            if (site1 != site2) {
+                                sink.match(index_a, index_b, maxDivergence, siteIndex[k] - 1);
+                                ++this->inPanelMatchNum;
+                            }
+                        }
+                    }
+                    report = false;
+                }
+                top = i;
+                blockSite = -1;
+            }
+            int site = X[array[k][i]][k];
+            if (blockSite == -1) {
+                blockSite = site;
+            } else if (site != blockSite) {
+                report = true;
+            }
+        }
+        if (report == true) {
+            for (int i_a = top; i_a < M - 1; i_a++) {
+                int maxDivergence = 0;
+                for (int i_b = i_a + 1; i_b < M; i_b++) {
+                    if (divergence[k][i_b] > maxDivergence) {
+                        maxDivergence = divergence[k][i_b];
+                    }
+                    uint32_t temp1, temp2, fuzzy1, fuzzy2;
+                    int index_a = array[k][i_a];
+                    int index_b = array[k][i_b];
+                    int site1 = X[index_a][k];
+                    int site2 = X[index_b][k];
+
+                    if (site1 != site2) {
+                        sink.match(index_a, index_b, maxDivergence, siteIndex[k] - 1);
+                    }
+                }
+            }
+        }
+    }
+
+    // 区域查询中延续到 b 的匹配终点为 b，在 b 处因等位基因不同而结束的匹配终点为 b-1
+    // (a == b 时不在区域内)。整个面板查询保留原有的输出约定: 在最后一个位点结束的
+    // 匹配终点记为该位点，最后一个块内的全部单倍型对终点记为 N
+    k = b;
+    int endSite = siteIndex[b + 1] - 1;
+    int brokenEnd = wholePanel ? siteIndex[k] : siteIndex[k] - 1;
+    bool reportBroken = wholePanel || k > a;
+    int top = 0;
+    for (int i = 0; i <= M; i++) {
+        if (i < M && divergence[k][i] <= endSite - L + 1) {
+            continue;
+        }
+        bool lastBlock = wholePanel && i == M;
+        int openEnd = lastBlock ? endSite + 1 : endSite;
+        for (int i_a = top; i_a < i - 1; i_a++) {
+            int maxDivergence = 0;
+            for (int i_b = i_a + 1; i_b < i; i_b++) {
+                if (divergence[k][i_b] > maxDivergence) {
+                    maxDivergence = divergence[k][i_b];
+                }
+                int index_a = array[k][i_a];
+                int index_b = array[k][i_b];
+                int site1 = X[index_a][k];
+                int site2 = X[index_b][k];
+
+                // 输出的终点沿用上述约定，阈值标注按两者实际最后相同的位点计算
+                if (site1 == site2) {
+                    sink.matchEndingAt(index_a, index_b, maxDivergence, openEnd, endSite);
+                } else if (lastBlock) {
+                    sink.matchEndingAt(index_a, index_b, maxDivergence, openEnd, siteIndex[k] - 1);
+                } else if (reportBroken && siteIndex[k] - maxDivergence >= L) {
+                    sink.matchEndingAt(index_a, index_b, maxDivergence, brokenEnd, siteIndex[k] - 1);
+                }
+            }
+        }
+        // 同组单倍型在全部位点上相同，随代表所在的块一起报告
+        for (int i_a = top; i_a < i && endSite + 1 >= L; i_a++) {
+            expanded.matchWithinGroup(array[k][i_a], 0, openEnd, endSite);
+        }
+        top = i;
+    }
+
+    end = clock();
+    this->inPanelQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    return 0;
+}
+
+int multiPBWT::inPanelTargetQuery(const vector<int>& targets, const vector<int>& Ls, string inPanelOutput_file) {
+    vector<int> thresholds;
+    if (!sortThresholds(Ls, thresholds))
+        return 3;
+
+    ofstream out(inPanelOutput_file);
+    if (out.fail())
+        return 2;
+
+    StreamMatchSink sink(out, IDs, IDs);
+    sink.setThresholds(thresholds, siteIndex[N] - 1);
+    int status = inPanelTargetQuery(targets, thresholds[0], sink);
+
+    out.close();
+    cout << "matches has been put into " << inPanelOutput_file << endl;
+    return status;
+}
+
+int multiPBWT::inPanelTargetQuery(const vector<int>& targets, int L, MatchSink& sink) {
+    clock_t start, end;
+    start = clock();
+
+    if (rl != nullptr) {
+        std::cerr << "压缩索引不支持面板内查询" << std::endl;
+        return 3;
+    }
+    int panelSize = IDs.size();
+    vector<int> sortedTargets = targets;
+    sort(sortedTargets.begin(), sortedTargets.end());
+    sortedTargets.erase(unique(sortedTargets.begin(), sortedTargets.end()), sortedTargets.end());
+    if (sortedTargets.empty() || sortedTargets[0] < 0 || sortedTargets.back() >= panelSize) {
+        std::cerr << "无效的目标单倍型: 需在 [0, " << panelSize << ") 内" << std::endl;
+        return 4;
+    }
+
+    // 化简后的面板上目标取其代表单倍型所在的行
+    vector<int> row(panelSize);
+    std::iota(row.begin(), row.end(), 0);
+    for (int r = 0; r < (int)haplotypeGroups.size(); r++) {
+        for (int h : haplotypeGroups[r]) {
+            row[h] = r;
+        }
+    }
+    vector<int> targetRank(panelSize, -1);
+    for (int i = 0; i < (int)sortedTargets.size(); i++) {
+        targetRank[sortedTargets[i]] = i;
+    }
+
+    // 把目标单倍型作为面板外查询逐个扫描，已读入的查询暂存并在结束后恢复
+    TargetMatchSink targetSink(sink, sortedTargets, targetRank);
+    Matrix<uint8_t> queries;
+    queries.swap(Z);
+    int status = 0;
+    try {
+        Z.assign(sortedTargets.size(), N);
+        for (size_t q = 0; q < sortedTargets.size(); q++) {
+            std::copy(X[row[sortedTargets[q]]], X[row[sortedTargets[q]]] + N, Z[q]);
+        }
+        status = outPanelMatchBatch(L, 0, N - 1, 0, targetSink);
+    } catch (const std::bad_alloc& e) {
+        std::cerr << "内存分配失败: " << e.what() << std::endl;
+        status = -1;
+    }
+    Z.swap(queries);
+
+    end = clock();
+    this->inPanelQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    return status;
+}
+
+int multiPBWT::outPanelLongMatchQuery(int L, string outPanelOutput_file) {
+    return outPanelRegionQuery(vector<int>{L}, 0, N - 1, outPanelOutput_file);
+}
+
+int multiPBWT::outPanelLongMatchQuery(const vector<int>& Ls, string outPanelOutput_file) {
+    return outPanelRegionQuery(Ls, 0, N - 1, outPanelOutput_file);
+}
+
+int multiPBWT::outPanelLongMatchQuery(int L, MatchSink& sink) {
+    return outPanelRegionQuery(L, 0, N - 1, sink);
+}
+
+int multiPBWT::outPanelRegionQuery(int L, int a, int b, string outPanelOutput_file) {
+    return outPanelRegionQuery(vector<int>{L}, a, b, outPanelOutput_file);
+}
+
+int multiPBWT::outPanelRegionQuery(const vector<int>& Ls, int a, int b, string outPanelOutput_file) {
+    vector<int> thresholds;
+    if (!sortThresholds(Ls, thresholds))
+        return 3;
+
+    ofstream out(outPanelOutput_file);
+    if (out.fail())
+        return 2;
+
+    StreamMatchSink sink(out, IDs, qIDs);
+    sink.setThresholds(thresholds, siteIndex[b + 1] - 1);
+    int status = outPanelRegionQuery(thresholds[0], a, b, sink);
+
+    out.close();
+    cout << "matches has been put into " << outPanelOutput_file << endl;
+    return status;
+}
+
+int multiPBWT::outPanelRegionQuery(int L, int a, int b, MatchSink& sink) {
+    clock_t start, end;
+    start = clock();
+
+    if (a < 0 || a > b || b >= N) {
+        std::cerr << "无效的区域: [" << a << ", " << b << "], N=" << N << std::endl;
+        return 4;
+    }
+    int status = outPanelMatchBatch(L, a, b, 0, sink);
+
+    end = clock();
+    this->outPanelQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    return status;
+}
+
+int multiPBWT::outPanelLongMatchQueryStream(int L, string query_file, int batchSize, string outPanelOutput_file) {
+    return outPanelLongMatchQueryStream(vector<int>{L}, query_file, batchSize, outPanelOutput_file);
+}
+
+int multiPBWT::outPanelLongMatchQueryStream(const vector<int>& Ls, string query_file, int batchSize,
+                                            string outPanelOutput_file) {
+    vector<int> thresholds;
+    if (!sortThresholds(Ls, thresholds))
+        return 3;
+
+    ofstream out(outPanelOutput_file);
+    if (out.fail())
+        return 2;
+
+    StreamMatchSink sink(out, IDs);
+    sink.setThresholds(thresholds, N - 1);
+    int status = outPanelLongMatchQueryStream(thresholds[0], query_file, batchSize, sink);
+
+    out.close();
+    cout << "matches has been put into " << outPanelOutput_file << endl;
+    return status;
+}
+
+bool multiPBWT::sortThresholds(const vector<int>& Ls, vector<int>& thresholds) {
+    thresholds = Ls;
+    sort(thresholds.begin(), thresholds.end());
+    thresholds.erase(unique(thresholds.begin(), thresholds.end()), thresholds.end());
+    if (thresholds.empty() || thresholds[0] <= 0) {
+        std::cerr << "无效的最小匹配长度" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int multiPBWT::outPanelLongMatchQueryStream(int L, string query_file, int batchSize, MatchSink& sink) {
+    clock_t start, end;
+    start = clock();
+
+    if (batchSize < 1) {
+        std::cerr << "无效的批大小: " << batchSize << std::endl;
+        return 3;
+    }
+    if (isReduced()) {
+        std::cerr << "化简后的面板不支持流式查询" << std::endl;
+        return 3;
+    }
+    std::ifstream in(query_file, std::ios::binary);
+    if (in.fail()) {
+        std::cerr << "无法打开查询文件: " << query_file << std::endl;
+        return 1;
+    }
+
+    // 每读入一个位点就把批内查询推进一步，匹配随读随出。第一批顺序读取整个文件，
+    // 同时确定 Q 并记录各 SITE 行单倍型数据的偏移；之后的批按偏移每行只读本批的字符
+    Q = 0;
+    vector<streamoff> offsets;
+    for (int qBegin = 0; qBegin == 0 || qBegin < Q; qBegin += batchSize) {
+        int status = outPanelStreamBatch(in, offsets, L, qBegin, batchSize, sink);
+        if (status != 0) {
+            return status;
+        }
+    }
+
+    end = clock();
+    this->outPanelQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    return 0;
+}
+
+int multiPBWT::readQuerySite(std::istream& in, std::string& line, size_t& pos, streamoff& offset, int k) {
+    pos = std::string::npos;
+    streamoff lineStart = in.tellg();
+    while (std::getline(in, line)) {
+        if (line.rfind("SITE:", 0) != 0) {
+            lineStart = in.tellg();
+            continue;
+        }
+        // 跳过前4个字段，定位单倍型数据的起始位置
+        pos = 0;
+        for (int field = 0; field < 4 && pos != std::string::npos; field++) {
+            pos = line.find('\t', pos);
+            if (pos != std::string::npos) {
+                ++pos;
+            }
+        }
+        if (pos == std::string::npos) {
+            std::cerr << "SITE行格式错误: 需要至少5个字段" << std::endl;
+            return 2;
+        }
+        offset = lineStart + (streamoff)pos;
+        size_t tokenEnd = line.find('\t', pos);
+        int length = (tokenEnd == std::string::npos ? line.size() : tokenEnd) - pos;
+        if (Q == 0) {
+            Q = length;
+            if (Q < 1) {
+                std::cerr << "无效的Q: " << Q << std::endl;
+                return 3;
+            }
+            std::cerr << "Q = " << Q << std::endl;
+        } else if (length != Q) {
+            std::cerr << "查询单倍型数据长度不匹配: 预期 " << Q << ", 实际 " << length << ", K=" << k << std::endl;
+            return 6;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+int multiPBWT::outPanelStreamBatch(std::ifstream& in, vector<streamoff>& offsets, int L, int qBegin, int batchSize,
+                                   MatchSink& sink) {
+    bool indexing = offsets.empty();
+    std::string line, buffer;
+    size_t pos;
+    streamoff offset;
+    int count = 0;
+    vector<QuerySweep> sweeps;
+    vector<RunLengthPBWT::Sweep> rlSweeps;
+    vector<BlockStarts> starts;
+    int k = 0;
+    for (;; k++) {
+        const char* data;
+        if (indexing) {
+            int status = readQuerySite(in, line, pos, offset, k);
+            if (status != 0) {
+                return status;
+            }
+            if (pos == std::string::npos) {
+                break;
+            }
+            if (k >= N) {
+                std::cerr << "查询位点数多于面板位点数 " << N << std::endl;
+                return 5;
+            }
+            offsets.push_back(offset);
+            data = line.data() + pos + qBegin;
+        } else {
+            if (k == N) {
+                break;
+            }
+            buffer.resize(min(batchSize, Q - qBegin));
+            in.clear();
+            in.seekg(offsets[k] + qBegin);
+            in.read(&buffer[0], buffer.size());
+            if (in.gcount() != (streamsize)buffer.size()) {
+                std::cerr << "读取查询文件失败: K=" << k << std::endl;
+                return 10;
+            }
+            data = buffer.data();
+        }
+        if (k == 0) {
+            // 批内每条查询只保存当前块内单倍型的匹配起点，从位点 0 开始的扫描初始状态全为 0
+            count = min(batchSize, Q - qBegin);
+            starts.assign(count, BlockStarts());
+            if (rl != nullptr) {
+                rlSweeps.assign(count, RunLengthPBWT::Sweep());
+            } else {
+                sweeps.assign(count, QuerySweep());
+                ftemp.resize(t);
+                gtemp.resize(t);
+            }
+        }
+
+        for (int index = 0; index < count; index++) {
+            int site = data[index] - '0';
+            if (site < 0 || site > 9) {
+                std::cerr << "无效的位点值: '" << data[index] << "' 在 K=" << k
+                          << ", index=" << qBegin + index << std::endl;
+                return 7;
+            }
+            if (rl != nullptr) {
+                rl->advance(rlSweeps[index], k, site, L, 0, qBegin + index, sink, starts[index]);
+            } else {
+                advanceQuery(sweeps[index], k, site, L, 0, qBegin + index, sink, starts[index]);
+            }
+        }
+    }
+    if (k == 0) {
+        std::cerr << "未找到SITE行" << std::endl;
+        return 2;
+    }
+    if (k != N) {
+        std::cerr << "查询位点数 " << k << " 与面板位点数 " << N << " 不匹配" << std::endl;
+        return 5;
+    }
+
+    for (int index = 0; index < count; index++) {
+        if (rl != nullptr) {
+            rl->finish(rlSweeps[index], N - 1, qBegin + index, sink, starts[index]);
+        } else {
+            finishQuery(sweeps[index], N - 1, qBegin + index, sink, starts[index]);
+        }
+    }
+    return 0;
+}
+
+void multiPBWT::locateQuery(const uint8_t* z, int a, int L, QuerySweep& sweep, PanelStarts& dZ) {
+    int& fakeLocation = sweep.fakeLocation;
+    int& Zdivergence = sweep.Zdivergence;
+    int& belowZdivergence = sweep.belowZdivergence;
+    int& f = sweep.f;
+    int& g = sweep.g;
+
+    // 按反向前缀 [0, a) 二分查找查询在 array[a] 中的插入位置，前缀完全相同的单倍型排在查询之后
+    int lo = 0, hi = M;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const uint8_t* x = X[array[a][mid]];
+        int s = a - 1;
+        while (s >= 0 && x[s] == z[s]) {
+            --s;
+        }
+        if (s >= 0 && x[s] < z[s]) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    fakeLocation = lo;
+
+    // 与相邻单倍型直接比较得到真实 divergence，再换算为原始位点
+    int upper = a, lower = a;
+    if (fakeLocation > 0) {
+        const uint8_t* x = X[array[a][fakeLocation - 1]];
+        while (upper > 0 && x[upper - 1] == z[upper - 1]) {
+            --upper;
+        }
+    }
+    if (fakeLocation < M) {
+        const uint8_t* x = X[array[a][fakeLocation]];
+        while (lower > 0 && x[lower - 1] == z[lower - 1]) {
+            --lower;
+        }
+    }
+    Zdivergence = upper > 0 ? siteIndex[upper - 1] + 1 : 0;
+    belowZdivergence = lower > 0 ? siteIndex[lower - 1] + 1 : 0;
+
+    // 位点 a 处已持续至少 L 的匹配组成初始块，dZ 为沿 divergence[a] 累积的真实起点
+    int limit = siteIndex[a] - L;
+    f = g = fakeLocation;
+    int matchStart = Zdivergence;
+    while (f > 0 && matchStart <= limit) {
+        --f;
+        dZ[array[a][f]] = matchStart;
+        matchStart = max(matchStart, divergence[a][f]);
+    }
+    matchStart = belowZdivergence;
+    while (g < M && matchStart <= limit) {
+        dZ[array[a][g]] = matchStart;
+        ++g;
+        if (g < M) {
+            matchStart = max(matchStart, divergence[a][g]);
+        }
+    }
+}
+
+int multiPBWT::outPanelMatchBatch(int L, int a, int b, int qBegin, MatchSink& output) {
+    ExpandingMatchSink expanded(output, haplotypeGroups, false);
+    MatchSink& sink = haplotypeGroups.empty() ? output : expanded;
+    dZ.resize(M);
+    if (rl != nullptr) {
+        for (int q = 0; q < (int)Z.size(); q++) {
+            int status = rl->outPanelQuery(Z[q], L, a, b, qBegin + q, sink, dZ);
+            if (status != 0) {
+                return status;
+            }
+        }
+        return 0;
+    }
+    ftemp.resize(t);
+    gtemp.resize(t);
+    PanelStarts starts(dZ.data());
+    for (int q = 0; q < (int)Z.size(); q++) {
+        QuerySweep sweep;
+        locateQuery(Z[q], a, L, sweep, starts);
+        for (int k = a; k <= b; k++) {
+            advanceQuery(sweep, k, Z[q][k], L, a, qBegin + q, sink, starts);
+        }
+        finishQuery(sweep, b, qBegin + q, sink, starts);
+    }
+    return 0;
+}
+
+template <typename Starts>
+void multiPBWT::advanceQuery(QuerySweep& sweep, int k, int querySite, int L, int a, int hapB, MatchSink& sink,
+                             Starts& dZ) {
+    // 查询在 array[k] 中的虚拟插入位置，以及与其上方/下方相邻单倍型的 divergence
+    int& fakeLocation = sweep.fakeLocation;
+    int& Zdivergence = sweep.Zdivergence;
+    int& belowZdivergence = sweep.belowZdivergence;
+    int& f = sweep.f;
+    int& g = sweep.g;
+
+    // 查询等位基因在本位点的稠密编码，面板中未出现时为 -1 (块随之清空)
+    const uint8_t* rank = &alleleRank[(size_t)k * 11];
+    const int* starts = &alleleStart[alleleOffset[k]];
+    int tk = rank[10];
+    int queryCode = rank[querySite + 1] != rank[querySite] ? rank[querySite] : -1;
+
+    // 前向虚拟插入: 由 divergence[k] 和 u 推出查询在 k+1 处的上下 divergence
+    int lower = symbolStart(k, querySite);
+    int upper = symbolStart(k, querySite + 1);
+    int nextLocation = fakeLocation != M ? symbolOcc(k, fakeLocation, querySite) : upper;
+    if (nextLocation == lower) {
+        Zdivergence = siteIndex[k] + 1;
+    } else {
+        for (int i = fakeLocation - 1; Zdivergence < siteIndex[k] && X[array[k][i]][k] != querySite; --i) {
+            Zdivergence = max(Zdivergence, divergence[k][i]);
+        }
+    }
+    if (nextLocation == upper) {
+        belowZdivergence = siteIndex[k] + 1;
+    } else {
+        for (int i = fakeLocation; belowZdivergence < siteIndex[k] && X[array[k][i]][k] != querySite;) {
+            ++i;
+            belowZdivergence = max(belowZdivergence, divergence[k][i]);
+        }
+    }
+    fakeLocation = nextLocation;
+
+    if (g == M) {
+        if (f == M) {
+            for (int c = 0; c < tk; c++) {
+                if (queryCode != c) {
+                    ftemp[c] = c + 1 < tk ? starts[c + 1] : M;
+                }
+            }
+            f = upper;
+        } else {
+            for (int c = 0; c < tk; c++) {
+                if (queryCode != c) {
+                    ftemp[c] = occ(k, f, c);
+                }
+            }
+            f = symbolOcc(k, f, querySite);
+        }
+        for (int c = 0; c < tk; c++) {
+            if (queryCode != c) {
+                gtemp[c] = c + 1 < tk ? starts[c + 1] : M;
+            }
+        }
+        g = upper;
+    } else {
+        for (int c = 0; c < tk; c++) {
+            if (c != queryCode) {
+                ftemp[c] = occ(k, f, c);
+                gtemp[c] = occ(k, g, c);
+            }
+        }
+        f = symbolOcc(k, f, querySite);
+        g = symbolOcc(k, g, querySite);
+    }
+
+    for (int i = 0; i < tk; i++) {
+        if (i != queryCode && k > a) {
+            while (ftemp[i] != gtemp[i]) {
+                int index = array[k + 1][ftemp[i]];
+                sink.match(index, hapB, dZ[index], siteIndex[k] - 1);
+                dZ.leave(index);
+                ++ftemp[i];
+            }
+        }
+    }
+
+    // 化简后的面板上匹配长度每步可增加多于 1，新进入块的单倍型取真实起点:
+    // 相邻单倍型为查询的 divergence，其余沿 divergence[k + 1] 由块内相邻成员累积
+    int limit = siteIndex[k + 1] - L;
+    if (f == g) {
+        if (f > 0 && Zdivergence <= limit) {
+            --f;
+            dZ[array[k + 1][f]] = Zdivergence;
+        }
+        if (g < M && belowZdivergence <= limit) {
+            dZ[array[k + 1][g]] = belowZdivergence;
+            ++g;
+        }
+    }
+    if (f != g) {
+        while (f > 0 && divergence[k + 1][f] <= limit) {
+            --f;
+            dZ[array[k + 1][f]] = max(dZ[array[k + 1][f + 1]], divergence[k + 1][f + 1]);
+        }
+        while (g < M && divergence[k + 1][g] <= limit) {
+            dZ[array[k + 1][g]] = max(dZ[array[k + 1][g - 1]], divergence[k + 1][g]);
+            ++g;
+        }
+    }
+}
+
+template <typename Starts>
+void multiPBWT::finishQuery(const QuerySweep& sweep, int b, int hapB, MatchSink& sink, Starts& dZ) {
+    for (int f = sweep.f; f != sweep.g; ++f) {
+        int index = array[b + 1][f];
+        sink.match(index, hapB, dZ[index], siteIndex[b + 1] - 1);
+    }
+}
+
+int multiPBWT::crossPanelLongMatchQuery(const vector<int>& Ls, string outPanelOutput_file) {
+    vector<int> thresholds;
+    if (!sortThresholds(Ls, thresholds))
+        return 3;
+
+    ofstream out(outPanelOutput_file);
+    if (out.fail())
+        return 2;
+
+    StreamMatchSink sink(out, IDs, qIDs);
+    sink.setThresholds(thresholds, N - 1);
+    int status = crossPanelLongMatchQuery(thresholds[0], sink);
+
+    out.close();
+    cout << "matches has been put into " << outPanelOutput_file << endl;
+    return status;
+}
+
+int multiPBWT::crossPanelLongMatchQuery(int L, MatchSink& sink) {
+    clock_t start, end;
+    start = clock();
+
+    if (rl != nullptr || isReduced()) {
+        std::cerr << "跨面板查询需要未化简、未压缩的面板单倍型" << std::endl;
+        return 3;
+    }
+    if (Z.empty()) {
+        std::cerr << "未读入查询单倍型" << std::endl;
+        return 4;
+    }
+
+    // 面板与查询合并后的排序: 编号 h < M 为面板单倍型，h >= M 为查询 h - M。
+    // 合并排序在任一集合上的限制即该集合自身的 PBWT 排序，只保留当前一列
+    int total = M + (int)Z.size();
+    vector<int> order(total), div(total, 0), nextOrder(total), nextDiv(total);
+    std::iota(order.begin(), order.end(), 0);
+    vector<uint8_t> code(total, 0);
+    vector<vector<int>> lists(20), gaps(20);
+    vector<int> runMax(20);
+    int a_count[10], p[10];
+
+    for (int k = 0; k <= N; k++) {
+        // 本位点在两个集合上出现的等位基因按符号顺序编为稠密编码; k == N 时所有匹配都在末位点结束
+        int tk = 1;
+        if (k == N) {
+            std::fill(code.begin(), code.end(), 0);
+        } else {
+            bool seen[10] = {false};
+            for (int i = 0; i < total; i++) {
+                int h = order[i];
+                seen[h < M ? X[h][k] : Z[h - M][k]] = true;
+            }
+            int rank[10];
+            tk = 0;
+            for (int s = 0; s < 10; s++) {
+                rank[s] = tk;
+                tk += seen[s];
+            }
+            for (int i = 0; i < total; i++) {
+                int h = order[i];
+                code[i] = rank[h < M ? X[h][k] : Z[h - M][k]];
+            }
+        }
+
+        // 块 [top, i) 内两两匹配至少 L 个位点 (终点 k-1)
+        int top = 0;
+        for (int i = 1; i <= total; i++) {
+            if (i == total || div[i] > k - L) {
+                if (i - top > 1 && (tk > 1 || k == N)) {
+                    crossPanelBlock(k, top, i, tk, order, div, code, lists, gaps, runMax, sink);
+                }
+                top = i;
+            }
+        }
+        if (k == N) {
+            break;
+        }
+
+        // 按本位点等位基因稳定划分，得到 k+1 处的合并排序和 divergence
+        for (int c = 0; c < tk; c++) {
+            a_count[c] = 0;
+            p[c] = k + 1;
+        }
+        for (int i = 0; i < total; i++) {
+            a_count[code[i]]++;
+        }
+        for (int c = 0, first = 0; c < tk; c++) {
+            int count = a_count[c];
+            a_count[c] = first;
+            first += count;
+        }
+        for (int i = 0; i < total; i++) {
+            for (int c = 0; c < tk; c++) {
+                if (div[i] > p[c]) {
+                    p[c] = div[i];
+                }
+            }
+            int c = code[i];
+            nextOrder[a_count[c]] = order[i];
+            nextDiv[a_count[c]] = p[c];
+            a_count[c]++;
+            p[c] = 0;
+        }
+        order.swap(nextOrder);
+        div.swap(nextDiv);
+    }
+
+    end = clock();
+    this->outPanelQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    return 0;
+}
+
+void multiPBWT::crossPanelBlock(int k, int top, int bottom, int tk, const vector<int>& order,
+                                const vector<int>& div, const vector<uint8_t>& code, vector<vector<int>>& lists,
+                                vector<vector<int>>& gaps, vector<int>& runMax, MatchSink& sink) {
+    // 按 (集合, 等位基因) 分组记录块内已扫过的单倍型，gaps 为与组内上一成员之间的最大 divergence，
+    // runMax 为组内最后一个成员之后的最大 divergence。新成员只与另一集合中等位基因不同的组配对
+    // (k == N 时与另一集合的所有成员配对)，因此只访问需要报告的对
+    for (int list = 0; list < 2 * tk; list++) {
+        lists[list].clear();
+        gaps[list].clear();
+        runMax[list] = 0;
+    }
+    for (int i = top; i < bottom; i++) {
+        if (i > top) {
+            for (int list = 0; list < 2 * tk; list++) {
+                runMax[list] = max(runMax[list], div[i]);
+            }
+        }
+        int h = order[i];
+        int set = h < M ? 0 : 1;
+        int c = code[i];
+        for (int other = 0; other < tk; other++) {
+            if (other == c && k < N) {
+                continue;
+            }
+            int list = (1 - set) * tk + other;
+            int matchStart = runMax[list];
+            for (int m = (int)lists[list].size() - 1; m >= 0; m--) {
+                int mate = lists[list][m];
+                if (set == 0) {
+                    sink.match(h, mate - M, matchStart, k - 1);
+                } else {
+                    sink.match(mate, h - M, matchStart, k - 1);
+                }
+                matchStart = max(matchStart, gaps[list][m]);
+            }
+        }
+        int list = set * tk + c;
+        lists[list].push_back(h);
+        gaps[list].push_back(runMax[list]);
+        runMax[list] = 0;
+    }
+}
@@ -4,8 +4,12 @@
  *  Created on: May 20, 2024
  *      Author: Cui Rongyue
  *      Modified: Split u array into multiple chunks using 1D vectors
+ *      Modified: Panel arrays in contiguous arena regions
  */
 
+#ifndef MULTIPBWT_H
+#define MULTIPBWT_H
+
 #include <chrono>
 #include <iostream>
 #include <algorithm>
@@ -14,734 +18,342 @@
 #include <sstream>
 #include <vector>
 #include <cmath>
+#include <cstring>
 #include <ctime>
 #include <string>
 #include <unistd.h>
 
-using namespace std;
+#include "Arena.h"
+#include "RunLengthPBWT.h"
 
-// Class to manage chunked allocation of u array using 1D vectors
-class ChunkedArray {
+// u array in one arena region. Position k holds width[k] ints per haplotype,
+// so sites with fewer alleles take less; offset[k] replaces the former chunk
+// divide and modulo on every access.
+class UArray {
 private:
-    vector<vector<int>> chunks; // Vector of 1D arrays
-    int chunkSize; // Number of k (positions) per chunk
-    int M, t, N; // Dimensions
-    int numChunks;
+    ArenaBuffer<int> data;
+    std::vector<size_t> offset; // Start of position k
+    std::vector<int> width; // Ints per haplotype at position k
 
 public:
-    ChunkedArray(int totalN, int M_val, int t_val, int numChunks_val = 10)
-        : N(totalN), M(M_val), t(t_val), numChunks(min(numChunks_val, totalN)) {
-        chunkSize = (N + numChunks - 1) / numChunks; // Ceiling division
-        chunks.resize(numChunks);
+    UArray(const std::vector<int>& width_val, int M)
+        : offset(width_val.size()), width(width_val) {
+        size_t size = 0;
+        for (size_t k = 0; k < width.size(); ++k) {
+            offset[k] = size;
+            size += (size_t)M * width[k];
+        }
         try {
-            for (int c = 0; c < numChunks; ++c) {
-                int currentChunkSize = min(chunkSize, N - c * chunkSize);
-                chunks[c].resize(currentChunkSize * M * t);
-                // std::cerr << "分配 chunk " << c << ", 大小: " <<
-                //     currentChunkSize * M * t * sizeof(int) / (1024.0 * 1024.0) << " MB" << std::endl;
-            }
+            data.assign(size, 0);
         } catch (const std::bad_alloc& e) {
-            std::cerr << "内存分配失败 (ChunkedArray): " << e.what() << std::endl;
+            std::cerr << "内存分配失败 (UArray): " << e.what() << std::endl;
             throw;
         }
     }
 
     int& operator()(int k, int i, int j) {
-        int chunkIdx = k / chunkSize;
-        int kInChunk = k % chunkSize;
-        int index = kInChunk * M * t + i * t + j;
-        return chunks[chunkIdx][index];
+        return data[offset[k] + (size_t)i * width[k] + j];
     }
 
     const int& operator()(int k, int i, int j) const {
-        int chunkIdx = k / chunkSize;
-        int kInChunk = k % chunkSize;
-        int index = kInChunk * M * t + i * t + j;
-        return chunks[chunkIdx][index];
+        return data[offset[k] + (size_t)i * width[k] + j];
     }
 };
 
-struct multiPBWT {
-    int M = 0;
-    int N = 0;
-    int maxSite = 0;
-    int t = 0;
-    double readPaneltime = 0;
-    double makePanelTime = 0;
-    double inPanelQuerytime = 0;
-    double readQuerytime = 0;
-    double outPanelQuerytime = 0;
-    u_long inPanelMatchNum = 0;
-    u_long outPanelMatchNum = 0;
-    vector<string> IDs;
-    vector<vector<uint8_t>> X; // MN bits
-    vector<vector<int>> array; // 32MN/B bits
-    vector<vector<int>> divergence; // 32MN/B bits
-    ChunkedArray* u; // Replaced int* u with ChunkedArray
-
-    int Q = 0;
-    vector<vector<uint8_t>> Z;
-    vector<string> qIDs;
-
-    int readMacsPanel(string txt_file);
-    int readMacsQuery(string txt_file);
-    int makePanel();
-    int inPanelLongMatchQuery(int L, string inPanelOutput_file);
-    int outPanelLongMatchQuery(int L, string outPanelOutput_file);
-
-    ~multiPBWT() {
-        delete u;
+// Receives every reported long match. hapA is a panel haplotype; hapB is a
+// panel haplotype for in-panel queries and a query haplotype for out-panel
+// queries. start/end are the same values written by the text output.
+class MatchSink {
+public:
+    virtual ~MatchSink() {}
+    virtual void match(int hapA, int hapB, int start, int end) = 0;
+    // A match whose reported end follows an output convention; lastShared is
+    // the last site the pair actually shares
+    virtual void matchEndingAt(int hapA, int hapB, int start, int end, int lastShared) {
+        match(hapA, hapB, start, end);
     }
 };
 
-int multiPBWT::readMacsPanel(string panel_file) {
-    clock_t start, end;
-    start = clock();
-    std::ifstream in(panel_file);
-    if (in.fail()) {
-        std::cerr << "无法打开文件: " << panel_file << std::endl;
-        return 1;
-    }
-
-    std::string line;
-
-    // Step 1: 计算单倍型数 (M)
-    M = 0;
-    bool found_site = false;
-    while (std::getline(in, line)) {
-        if (line.rfind("SITE:", 0) == 0) {
-            found_site = true;
-            std::stringstream ss(line);
-            std::string token;
-            std::vector<std::string> tokens;
-            while (std::getline(ss, token, '\t')) {
-                tokens.push_back(token);
-            }
-            if (tokens.size() < 5) {
-                std::cerr << "SITE行格式错误: 需要至少5个字段，实际为 " << tokens.size() << std::endl;
-                return 2;
-            }
-            M = tokens[4].size();
-            break;
-        }
-    }
-    if (!found_site) {
-        std::cerr << "未找到SITE行" << std::endl;
-        return 2;
-    }
-    if (M < 1) {
-        std::cerr << "无效的M: " << M << std::endl;
-        return 3;
-    }
-    std::cerr << "M = " << M << std::endl;
-
-    // Step 2: 设置IDs
-    IDs.resize(M);
-    for (int i = 0; i < M; i++) {
-        IDs[i] = std::to_string(i);
-    }
+// Writes matches as "<hapA ID>\t<hapB ID>\t<start>\t<end>" lines. Without
+// bIDs the index of hapB is written instead (streamed queries keep no IDs).
+// With more than one threshold each line gets a fifth column: the largest
+// threshold the match length reaches, measured to lastShared (end clipped to
+// lastSite for plain matches).
+class StreamMatchSink : public MatchSink {
+private:
+    std::ostream& out;
+    const std::vector<std::string>& aIDs;
+    const std::vector<std::string>* bIDs;
+    std::vector<int> thresholds;
+    int lastSite = 0;
 
-    // Step 3: 计算位点数 (N)
-    N = 0;
-    in.clear();
-    in.seekg(0);
-    while (std::getline(in, line)) {
-        if (line.rfind("SITE:", 0) == 0) {
-            N++;
-        }
-    }
-    if (N < 1) {
-        std::cerr << "无效的N: " << N << std::endl;
-        return 4;
-    }
+public:
+    StreamMatchSink(std::ostream& out_val, const std::vector<std::string>& aIDs_val, const std::vector<std::string>& bIDs_val)
+        : out(out_val), aIDs(aIDs_val), bIDs(&bIDs_val) {}
 
-    // Step 4: 初始化数据结构
-    try {
-        X.resize(M, vector<uint8_t>(N));
-        array.resize(N + 1, std::vector<int>(M));
-        std::iota(array[0].begin(), array[0].end(), 0);
-        divergence.resize(N + 1, std::vector<int>(M, 0));
+    StreamMatchSink(std::ostream& out_val, const std::vector<std::string>& aIDs_val)
+        : out(out_val), aIDs(aIDs_val), bIDs(nullptr) {}
 
-    } catch (const std::bad_alloc& e) {
-        std::cerr << "内存分配失败: " << e.what() << std::endl;
-        return -1;
+    void match(int hapA, int hapB, int start, int end) override {
+        matchEndingAt(hapA, hapB, start, end, std::min(end, lastSite));
     }
 
-    // Step 5: 处理SITE行
-    in.clear();
-    in.seekg(0);
-
-    int K = 0;
-    while (std::getline(in, line)) {
-        if (line.rfind("SITE:", 0) != 0) {
-            continue;
+    void matchEndingAt(int hapA, int hapB, int start, int end, int lastShared) override {
+        out << aIDs[hapA] << '\t';
+        if (bIDs != nullptr) {
+            out << (*bIDs)[hapB];
+        } else {
+            out << hapB;
         }
-
-        if (K >= N) {
-            std::cerr << "SITE行数过多: K=" << K << ", 预期N=" << N << std::endl;
-            return 10;
+        out << '\t' << start << '\t' << end;
+        if (thresholds.size() > 1) {
+            // 整个面板约定下最后一个块内的单倍型对可能短于最小阈值，仍标注为最小阈值
+            int length = lastShared - start + 1;
+            auto reached = std::upper_bound(thresholds.begin(), thresholds.end(), length);
+            out << '\t' << (reached == thresholds.begin() ? thresholds[0] : *(reached - 1));
         }
-
-        std::stringstream ss(line);
-        std::string token;
-        std::getline(ss, token, '\t'); // Skip "SITE:"
-        std::getline(ss, token, '\t'); // Skip index
-        std::getline(ss, token, '\t'); // Skip physLoc
-        std::getline(ss, token, '\t'); // Skip other column
-        std::getline(ss, token, '\t'); // Get haplotype data
-
-        if (token.size() != M) {
-            std::cerr << "单倍型数据长度不匹配: 预期 " << M << ", 实际 " << token.size() << ", K=" << K << std::endl;
-            return 6;
-        }
-
-        int index = 0;
-        for (char c : token) {
-            if (index >= M) {
-                std::cerr << "索引越界: index=" << index << ", M=" << M << ", K=" << K << std::endl;
-                return 9;
-            }
-            int site = c - '0';
-            if (site > maxSite) {
-                maxSite = site;
-            }
-            X[index][K] = site;
-            index++;
-        }
-        if (index != M) {
-            std::cerr << "处理了 " << index << " 个单倍型，预期 " << M << ", K=" << K << std::endl;
-            return 9;
-        }
-
-        K++;
+        out << '\n';
     }
 
-    if (K != N) {
-        std::cerr << "处理了 " << K << " 个位点，预期 " << N << std::endl;
-        return 10;
+    // thresholds must be ascending; the sweep is run at thresholds[0]
+    void setThresholds(const std::vector<int>& thresholds_val, int lastSite_val) {
+        thresholds = thresholds_val;
+        lastSite = lastSite_val;
     }
-    t = maxSite + 1;
-    try {
-        u = new ChunkedArray(N, M, t, 50); // Allocate u in 50 chunks
-    } catch (const std::bad_alloc& e) {
-        std::cerr << "内存分配失败 (u 数组): " << e.what() << std::endl;
-        return -1;
-    }
-
-    end = clock();
-    readPaneltime = ((double)(end - start)) / CLOCKS_PER_SEC;
-
-    return 0;
-}
-
-int multiPBWT::readMacsQuery(string txt_file) {
-    clock_t start, end;
-    start = clock();
+};
 
-    std::ifstream in(txt_file);
-    if (in.fail()) {
-        std::cerr << "无法打开查询文件: " << txt_file << std::endl;
-        return 1;
-    }
+// Expands matches found on a reduced panel (see multiPBWT::reducePanel): each
+// representative haplotype stands for its group of identical original
+// haplotypes. hapB is expanded as well for in-panel queries.
+class ExpandingMatchSink : public MatchSink {
+private:
+    MatchSink& inner;
+    const std::vector<std::vector<int>>& groups;
+    bool expandB;
 
-    std::string line;
-
-    // Step 1: 计算查询单倍型数 (Q)
-    Q = 0;
-    bool found_site = false;
-    while (std::getline(in, line)) {
-        if (line.rfind("SITE:", 0) == 0) {
-            found_site = true;
-            std::stringstream ss(line);
-            std::string token;
-            std::vector<std::string> tokens;
-            while (std::getline(ss, token, '\t')) {
-                tokens.push_back(token);
+public:
+    ExpandingMatchSink(MatchSink& inner_val, const std::vector<std::vector<int>>& groups_val, bool expandB_val)
+        : inner(inner_val), groups(groups_val), expandB(expandB_val) {}
+
+    void match(int hapA, int hapB, int start, int end) override {
+        for (int a : groups[hapA]) {
+            if (!expandB) {
+                inner.match(a, hapB, start, end);
+                continue;
             }
-            if (tokens.size() < 5) {
-                std::cerr << "SITE行格式错误: 需要至少5个字段，实际为 " << tokens.size() << std::endl;
-                return 2;
+            for (int b : groups[hapB]) {
+                inner.match(a, b, start, end);
             }
-            Q = tokens[4].size();
-            break;
-        }
-    }
-    if (!found_site) {
-        std::cerr << "未找到SITE行" << std::endl;
-        return 2;
-    }
-    if (Q < 1) {
-        std::cerr << "无效的Q: " << Q << std::endl;
-        return 3;
-    }
-    std::cerr << "Q = " << Q << std::endl;
-
-    // Step 2: 设置查询 IDs
-    qIDs.resize(Q);
-    for (int i = 0; i < Q; i++) {
-        qIDs[i] = std::to_string(i);
-    }
-
-    // Step 3: 计算位点数并验证
-    int query_N = 0;
-    in.clear();
-    in.seekg(0);
-    while (std::getline(in, line)) {
-        if (line.rfind("SITE:", 0) == 0) {
-            query_N++;
         }
     }
-    if (query_N < 1) {
-        std::cerr << "无效的查询位点数: " << query_N << std::endl;
-        return 4;
-    }
-    if (N > 0 && query_N != N) {
-        std::cerr << "查询位点数 " << query_N << " 与面板位点数 " << N << " 不匹配" << std::endl;
-        return 5;
-    }
-    if (N == 0) {
-        N = query_N; // 若未调用 readMacsPanel，设置 N
-    }
-
-    // Step 4: 初始化数据结构
-    try {
-        Z.resize(Q, std::vector<uint8_t>(N));
-    } catch (const std::bad_alloc& e) {
-        std::cerr << "内存分配失败: " << e.what() << std::endl;
-        return -1;
-    }
 
-    // Step 5: 处理 SITE 行
-    in.clear();
-    in.seekg(0);
-    int K = 0;
-    while (std::getline(in, line)) {
-        if (line.rfind("SITE:", 0) != 0) {
-            continue;
-        }
-
-        if (K >= N) {
-            std::cerr << "SITE行数过多: K=" << K << ", 预期N=" << N << std::endl;
-            return 10;
-        }
-
-        std::stringstream ss(line);
-        std::string token;
-        std::getline(ss, token, '\t'); // Skip "SITE:"
-        std::getline(ss, token, '\t'); // Skip index
-        std::getline(ss, token, '\t'); // Skip physLoc
-        std::getline(ss, token, '\t'); // Skip other column
-        std::getline(ss, token, '\t'); // Get haplotype data
-
-        if (token.size() != Q) {
-            std::cerr << "查询单倍型数据长度不匹配: 预期 " << Q << ", 实际 " << token.size() << ", K=" << K << std::endl;
-            return 6;
-        }
-
-        int index = 0;
-        for (char c : token) {
-            if (index >= Q) {
-                std::cerr << "索引越界: index=" << index << ", Q=" << Q << ", K=" << K << std::endl;
-                return 9;
+    void matchEndingAt(int hapA, int hapB, int start, int end, int lastShared) override {
+        for (int a : groups[hapA]) {
+            if (!expandB) {
+                inner.matchEndingAt(a, hapB, start, end, lastShared);
+                continue;
             }
-            int site = c - '0';
-            if (site < 0 || site > 9) {
-                std::cerr << "无效的位点值: '" << c << "' 在 K=" << K << ", index=" << index << std::endl;
-                return 7;
+            for (int b : groups[hapB]) {
+                inner.matchEndingAt(a, b, start, end, lastShared);
             }
-            Z[index][K] = site;
-            index++;
-        }
-        if (index != Q) {
-            std::cerr << "处理了 " << index << " 个查询单倍型，预期 " << Q << ", K=" << K << std::endl;
-            return 9;
         }
-
-        K++;
     }
 
-    if (K != N) {
-        std::cerr << "处理了 " << K << " 个位点，预期 " << N << std::endl;
-        return 10;
-    }
-
-    end = clock();
-    readQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
-
-    in.close();
-    return 0;
-}
-
-int multiPBWT::makePanel() {
-    clock_t start, end;
-    start = clock();
-
-    int a_count[t] = {0};
-    int d_count[t] = {0};
-    int a[t][M];
-    int d[t][M];
-    int p[t];
-    for (int k = 0; k < N; k++) {
-        for (int _ = 0; _ < t; _++) {
-            p[_] = k + 1;
-        }
-
-        for (int i = 0; i < M; i++) {
-            for (int _ = 0; _ < t; _++) {
-                (*u)(k, i, _) = a_count[_];
-                if (divergence[k][i] > p[_]) {
-                    p[_] = divergence[k][i];
-                }
-            }
-            int index = array[k][i];
-            int site = X[index][k];
-
-            a[site][a_count[site]] = index;
-            d[site][d_count[site]] = p[site];
-            a_count[site]++;
-            d_count[site]++;
-            p[site] = 0;
-        }
-        int m = 0;
-        for (int _ = 0; _ < t; _++) {
-            for (int w = 0; w < a_count[_]; w++) {
-                array[k + 1][m] = a[_][w];
-                divergence[k + 1][m] = d[_][w];
-                ++m;
-            }
-        }
-        if (m != M) {
-            return 4;
-        }
-        for (int _ = 1; _ < t; _++) {
-            int plus = 0;
-            for (int j = 0; j < _; j++) {
-                plus += a_count[j];
-            }
-            for (int j = 0; j < M; j++) {
-                (*u)(k, j, _) += plus;
-            }
-        }
-        for (int _ = 0; _ < t; _++) {
-            a_count[_] = 0;
-            d_count[_] = 0;
-        }
-    }
-    end = clock();
-    makePanelTime = ((double)(end - start)) / CLOCKS_PER_SEC;
-    return 0;
-}
-
-int multiPBWT::inPanelLongMatchQuery(int L, string inPanelOutput_file) {
-    clock_t start, end;
-    start = clock();
-
-    ofstream out(inPanelOutput_file);
-    if (out.fail())
-        return 2;
-
-    int k;
-    for (k = 0; k < N - 1; k++) {
-        bool m[t];
-        for (int _ = 0; _ < t; _++) {
-            m[_] = false;
-        }
-        int top = 0;
-        bool report = false;
-        for (int i = 0; i < M; i++) {
-            if (divergence[k][i] > k - L) {
-                for (int w = 0; w < t - 1; w++) {
-                    for (int v = w + 1; v < t; v++) {
-                        if (m[w] == true && m[v] == true) {
-                            report = true;
-                            break;
-                        }
-                    }
-                }
-                if (report == true) {
-                    for (int i_a = top; i_a < i - 1; i_a++) {
-                        int maxDivergence = 0;
-                        for (int i_b = i_a + 1; i_b < i; i_b++) {
-                            if (divergence[k][i_b] > maxDivergence) {
-                                maxDivergence = divergence[k][i_b];
-                            }
-                            uint32_t temp1, temp2, fuzzy1, fuzzy2;
-                            int index_a = array[k][i_a], index_b = array[k][i_b];
-                            int site1 = X[index_a][k];
-                            int site2 = X[index_b][k];
-
-                            if (site1 != site2) {
-                                out << IDs[index_a] << '\t' << IDs[index_b] << '\t' << maxDivergence << '\t'
-                                    << k-1 << '\n';
-                                ++this->inPanelMatchNum;
-                            }
-                        }
-                    }
-                    report = false;
-                }
-                top = i;
-                for (int _ = 0; _ < t; _++) {
-                    m[_] = false;
-                }
-            }
-            int site = X[array[k][i]][k];
-            m[site] = true;
-        }
-        for (int w = 0; w < t - 1; w++) {
-            for (int v = w + 1; v < t; v++) {
-                if (m[w] == true && m[v] == true) {
-                    report = true;
-                }
-            }
+    // Pairs inside the group of hap are identical over every site
+    void matchWithinGroup(int hap, int start, int end, int lastShared) {
+        if (groups.empty()) {
+            return;
         }
-        if (report == true) {
-            for (int i_a = top; i_a < M - 1; i_a++) {
-                int maxDivergence = 0;
-                for (int i_b = i_a + 1; i_b < M; i_b++) {
-                    if (divergence[k][i_b] > maxDivergence) {
-                        maxDivergence = divergence[k][i_b];
-                    }
-                    uint32_t temp1, temp2, fuzzy1, fuzzy2;
-                    int index_a = array[k][i_a];
-                    int index_b = array[k][i_b];
-                    int site1 = X[index_a][k];
-                    int site2 = X[index_b][k];
-
-                    if (site1 != site2) {
-                        out << IDs[index_a] << '\t' << IDs[index_b] << '\t' << maxDivergence << '\t'
-                            << k-1 << '\n';
-                    }
-                }
+        const std::vector<int>& group = groups[hap];
+        for (size_t i = 0; i + 1 < group.size(); i++) {
+            for (size_t j = i + 1; j < group.size(); j++) {
+                inner.matchEndingAt(group[i], group[j], start, end, lastShared);
             }
         }
     }
+};
 
-    int top = 0;
-    for (int i = 0; i < M; i++) {
-        if (divergence[k][i] > k - L + 1) {
-            for (int i_a = top; i_a < i - 1; i_a++) {
-                int maxDivergence = 0;
-                for (int i_b = i_a + 1; i_b < i; i_b++) {
-                    if (divergence[k][i_b] > maxDivergence) {
-                        maxDivergence = divergence[k][i_b];
-                    }
-                    int index_a = array[k][i_a];
-                    int index_b = array[k][i_b];
-                    int site1 = X[index_a][k];
-                    int site2 = X[index_b][k];
-
-                    if (site1 == site2) {
-                        out << IDs[index_a] << '\t' << IDs[index_b] << '\t' << maxDivergence << '\t'
-                            << k << '\n';
-                    } else if (site1 != site2) {
-                        if (k - maxDivergence >= L) {
-                            out << IDs[index_a] << '\t' << IDs[index_b] << '\t' << maxDivergence << '\t'
-                                << k << '\n';
-                        }
-                    }
-                }
-            }
-            top = i;
-        }
-    }
-    for (int i_a = top; i_a < M - 1; i_a++) {
-        int maxDivergence = 0;
-        for (int i_b = i_a + 1; i_b < M; i_b++) {
-            int index_a = array[k][i_a];
-            int index_b = array[k][i_b];
-            if (divergence[k][i_b] > maxDivergence) {
-                maxDivergence = divergence[k][i_b];
-            }
-            out << IDs[index_a] << '\t' << IDs[index_b] << '\t' << maxDivergence << '\t'
-                << N << '\n';
-        }
-    }
+// Turns the out-panel reports of target sweeps (hapB indexes targets) into
+// in-panel pairs with the target as hapA. Self matches are dropped, and a pair
+// of two targets is kept only from the sweep of the earlier one.
+class TargetMatchSink : public MatchSink {
+private:
+    MatchSink& inner;
+    const std::vector<int>& targets;
+    const std::vector<int>& targetRank; // Position in targets of each panel haplotype, -1 if not a target
 
-    end = clock();
-    this->inPanelQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
-
-    out.close();
-    cout << "matches has been put into " << inPanelOutput_file << endl;
-    return 0;
-}
-
-int multiPBWT::outPanelLongMatchQuery(int L, string outPanelOutput_file) {
-    clock_t start, end;
-    start = clock();
-
-    ofstream out(outPanelOutput_file);
-    if (out.fail())
-        return 2;
-
-    vector<int> dZ(M);
-    dZ.shrink_to_fit();
-    vector<int> fakeLocation(N + 1);
-    fakeLocation.shrink_to_fit();
-    vector<int> Zdivergence(N + 2);
-    Zdivergence.shrink_to_fit();
-    vector<int> belowZdivergence(N + 2);
-    belowZdivergence.shrink_to_fit();
-    for (int q = 0; q < Q; q++) {
-        fill(dZ.begin(), dZ.end(), 0);
-        fill(fakeLocation.begin(), fakeLocation.end(), 0);
-        fill(Zdivergence.begin(), Zdivergence.end(), 0);
-        fill(belowZdivergence.begin(), belowZdivergence.end(), 0);
-
-        string qID = qIDs[q >> 1] + "-" + to_string(q & 1);
-        fakeLocation[0] = 0;
-
-        for (int k = 0; k < N; k++) {
-            int site = Z[q][k];
-            if (fakeLocation[k] != M) {
-                fakeLocation[k + 1] = (*u)(k, fakeLocation[k], site);
-            } else {
-                if (site < t - 1) {
-                    fakeLocation[k + 1] = (*u)(k, 0, site + 1);
-                } else if (site == t - 1) {
-                    fakeLocation[k + 1] = M;
-                } else {
-                    return 3;
-                }
-            }
-        }
+public:
+    TargetMatchSink(MatchSink& inner_val, const std::vector<int>& targets_val, const std::vector<int>& targetRank_val)
+        : inner(inner_val), targets(targets_val), targetRank(targetRank_val) {}
 
-        Zdivergence[N + 1] = belowZdivergence[N + 1] = N;
-        for (int k = N; k >= 0; --k) {
-            Zdivergence[k] = std::min(Zdivergence[k + 1], k);
-            belowZdivergence[k] = std::min(belowZdivergence[k + 1], k);
-            if (fakeLocation[k] != 0) {
-                int index = array[k][fakeLocation[k] - 1];
-                int panelSite = X[index][(Zdivergence[k] - 1)];
-                int querySite = Z[q][(Zdivergence[k] - 1)];
-
-                while (Zdivergence[k] > 0 && panelSite == querySite) {
-                    --Zdivergence[k];
-                    panelSite = X[index][(Zdivergence[k] - 1)];
-                    querySite = Z[q][(Zdivergence[k] - 1)];
-                }
-            } else {
-                Zdivergence[k] = k;
-            }
-            if (fakeLocation[k] < M) {
-                int index = array[k][fakeLocation[k]];
-                int panelSite = X[index][belowZdivergence[k] - 1];
-                int querySite = Z[q][belowZdivergence[k] - 1];
-                while (belowZdivergence[k] > 0 && panelSite == querySite) {
-                    belowZdivergence[k]--;
-                    panelSite = X[index][belowZdivergence[k] - 1];
-                    querySite = Z[q][belowZdivergence[k] - 1];
-                }
-            } else {
-                belowZdivergence[k] = k;
-            }
+    void match(int hapA, int hapB, int start, int end) override {
+        int target = targets[hapB];
+        if (hapA == target || (targetRank[hapA] != -1 && targetRank[hapA] < hapB)) {
+            return;
         }
+        inner.match(target, hapA, start, end);
+    }
+};
 
-        int f, g;
-        f = g = fakeLocation[0];
-        vector<int> ftemp, gtemp;
-        ftemp.resize(t);
-        gtemp.resize(t);
-
-        for (int k = 0; k < N; k++) {
-            int querySite = Z[q][k];
-            if (g == M) {
-                if (f == M) {
-                    for (int i = 0; i < t; i++) {
-                        if (querySite != i) {
-                            if (i != t - 1) {
-                                ftemp[i] = (*u)(k, 0, i + 1);
-                            } else {
-                                ftemp[i] = M;
-                            }
-                        }
-                    }
-                    if (querySite != t - 1) {
-                        f = (*u)(k, 0, querySite + 1);
-                    } else {
-                        f = M;
-                    }
-                } else {
-                    for (int i = 0; i < t; i++) {
-                        if (querySite != i) {
-                            ftemp[i] = (*u)(k, f, i);
-                        }
-                    }
-                    f = (*u)(k, f, querySite);
-                }
-                for (int i = 0; i < t; i++) {
-                    if (querySite != i) {
-                        if (i < t - 1) {
-                            gtemp[i] = (*u)(k, 0, i + 1);
-                        } else {
-                            gtemp[i] = M;
-                        }
-                    }
-                }
-                if (querySite < t - 1) {
-                    g = (*u)(k, 0, querySite + 1);
-                } else {
-                    g = M;
-                }
-            } else {
-                for (int i = 0; i < t; i++) {
-                    if (i != querySite) {
-                        ftemp[i] = (*u)(k, f, i);
-                        gtemp[i] = (*u)(k, g, i);
-                    }
-                }
-                f = (*u)(k, f, querySite);
-                g = (*u)(k, g, querySite);
-            }
+struct multiPBWT {
+    int M = 0;
+    int N = 0;
+    int maxSite = 0;
+    int t = 0; // Largest allele count of any site (compressed index: maxSite + 1)
+    double readPaneltime = 0;
+    double makePanelTime = 0;
+    double inPanelQuerytime = 0;
+    double readQuerytime = 0;
+    double outPanelQuerytime = 0;
+    u_long inPanelMatchNum = 0;
+    u_long outPanelMatchNum = 0;
+    std::vector<std::string> IDs;
+    Matrix<uint8_t> X; // MN bits
+    Matrix<int> array; // 32MN/B bits
+    Matrix<int> divergence; // 32MN/B bits
+    UArray* u = nullptr; // Replaced int* u with UArray
+    RunLengthPBWT* rl = nullptr; // Run-length compressed index, replaces X/array/divergence/u when set
+    std::vector<int> siteIndex; // N + 1 original site of each column, siteIndex[N] = original N
+    std::vector<std::vector<int>> haplotypeGroups; // original haplotypes behind each row of X, empty if not reduced
+    // Per-site allele dictionary. alleleRank[k * 11 + s] is the number of
+    // alleles seen at site k with a symbol below s (s = 0..10), i.e. the dense
+    // code of s; alleleRank[k * 11 + 10] is the allele count of site k.
+    // alleleStart holds u(k, 0, code) from alleleOffset[k] on. u keeps no
+    // column on monomorphic sites and only code 0 on biallelic sites.
+    std::vector<uint8_t> alleleRank;
+    std::vector<int> alleleStart;
+    std::vector<int> alleleOffset;
+    std::vector<int> uWidth; // Ints per haplotype of u at each site
 
-            for (int i = 0; i < t; i++) {
-                if (i != querySite) {
-                    while (ftemp[i] != gtemp[i]) {
-                        int index = array[k + 1][ftemp[i]];
-                        out << IDs[index] << '\t' << this->qIDs[q] << '\t' << dZ[index] << '\t'
-                            << k-1 << '\n';
-                        ++ftemp[i];
-                    }
-                }
-            }
+    int Q = 0;
+    Matrix<uint8_t> Z;
+    std::vector<std::string> qIDs;
+
+    int readMacsPanel(std::string txt_file);
+    int readMacsQuery(std::string txt_file);
+    // Builds only the run-length compressed index (no X/array/divergence/u);
+    // out-panel queries then run against it, in-panel queries are unavailable.
+    int readMacsPanelCompressed(std::string panel_file);
+    // In-memory loaders: haplotype-major buffers, haplotypes[i * N_val + k]
+    int loadPanel(const uint8_t* haplotypes, int M_val, int N_val);
+    int loadQuery(const uint8_t* haplotypes, int Q_val, int N_val);
+    // Drops sites monomorphic over the panel and the loaded queries and keeps
+    // one representative per group of identical haplotypes; call before
+    // makePanel. Matches are still reported in original sites and haplotypes.
+    int reducePanel();
+    // Allocates array/divergence/u and builds them; the loaders keep only X
+    // and the allele dictionary.
+    int makePanel();
+    int inPanelLongMatchQuery(int L, std::string inPanelOutput_file);
+    int inPanelLongMatchQuery(int L, MatchSink& sink);
+    // Several minimum lengths in one sweep: runs at the smallest and tags each
+    // match with the largest threshold it reaches
+    int inPanelLongMatchQuery(const std::vector<int>& Ls, std::string inPanelOutput_file);
+    // One-vs-all in-panel query for the listed panel haplotypes: each target is
+    // swept through array/divergence like an out-panel query, so the cost
+    // follows the targets and their matches instead of all pairs. Each pair is
+    // reported once with the target as hapA; open matches end at the last site.
+    int inPanelTargetQuery(const std::vector<int>& targets, int L, MatchSink& sink);
+    int inPanelTargetQuery(const std::vector<int>& targets, const std::vector<int>& Ls, std::string inPanelOutput_file);
+    int outPanelLongMatchQuery(int L, std::string outPanelOutput_file);
+    int outPanelLongMatchQuery(int L, MatchSink& sink);
+    int outPanelLongMatchQuery(const std::vector<int>& Ls, std::string outPanelOutput_file);
+    // Region queries over sites [a, b]: the sweep starts from array[a]/divergence[a],
+    // matches in progress at a keep their true start, matches still open at b
+    // are reported with end b and matches broken at b with end b - 1.
+    int inPanelRegionQuery(int L, int a, int b, std::string inPanelOutput_file);
+    int inPanelRegionQuery(int L, int a, int b, MatchSink& sink);
+    int inPanelRegionQuery(const std::vector<int>& Ls, int a, int b, std::string inPanelOutput_file);
+    int outPanelRegionQuery(int L, int a, int b, std::string outPanelOutput_file);
+    int outPanelRegionQuery(int L, int a, int b, MatchSink& sink);
+    int outPanelRegionQuery(const std::vector<int>& Ls, int a, int b, std::string outPanelOutput_file);
+    // Panel-vs-panel matching: sweeps the merged PBWT ordering of the panel and
+    // the loaded queries site by site (restricted to either set it is that
+    // set's own ordering) and reports only panel-query pairs, in
+    // O((M + Q) N) plus output. Needs X and Z but not the panel index.
+    int crossPanelLongMatchQuery(int L, MatchSink& sink);
+    int crossPanelLongMatchQuery(const std::vector<int>& Ls, std::string outPanelOutput_file);
+    // Out-panel query that reads query haplotypes batchSize at a time from the
+    // MaCS file instead of loading all Q into Z; hapB is the global index. A
+    // batch advances its queries a site per line read, so matches are reported
+    // while the file is read. The first batch reads the file sequentially and
+    // records where each SITE line's haplotypes start; later batches seek there
+    // and read only their own columns. Each query keeps the match starts of its
+    // current block only. A malformed file can still fail after some matches
+    // have been reported.
+    int outPanelLongMatchQueryStream(int L, std::string query_file, int batchSize, std::string outPanelOutput_file);
+    int outPanelLongMatchQueryStream(int L, std::string query_file, int batchSize, MatchSink& sink);
+    int outPanelLongMatchQueryStream(const std::vector<int>& Ls, std::string query_file, int batchSize, std::string outPanelOutput_file);
 
-            if (f == g) {
-                if (k + 1 - Zdivergence[k + 1] == L) {
-                    --f;
-                    dZ[array[k + 1][f]] = k + 1 - L;
-                }
-                if (k + 1 - belowZdivergence[k + 1] == L) {
-                    dZ[array[k + 1][g]] = k + 1 - L;
-                    ++g;
-                }
-            }
-            if (f != g) {
-                while (divergence[k + 1][f] <= k + 1 - L) {
-                    --f;
-                    dZ[array[k + 1][f]] = k + 1 - L;
-                }
-                while (g < M && divergence[k + 1][g] <= k + 1 - L) {
-                    dZ[array[k + 1][g]] = k + 1 - L;
-                    ++g;
-                }
-            }
-        }
+    ~multiPBWT() {
+        delete u;
+        delete rl;
+    }
 
-        while (f != g) {
-            int index = array[N][f];
-            out << IDs[index] << '\t' << this->qIDs[q] << '\t' << dZ[index] << '\t'
-                << N-1 << '\n';
-            ++f;
+private:
+    int buildAlleleDictionary();
+    int allocateIndex();
+    // In-panel sweep over [a, b]. wholePanel keeps the whole-panel output
+    // convention at the last site: pairs broken there end at N - 1 and pairs
+    // in the last block end at N.
+    int inPanelSweep(int L, int a, int b, bool wholePanel, MatchSink& sink);
+    int inPanelSweep(const std::vector<int>& Ls, int a, int b, bool wholePanel, std::string inPanelOutput_file);
+    bool isReduced() const;
+
+    int alleleCount(int k) const {
+        return alleleRank[k * 11 + 10];
+    }
+
+    // u(k, i, c) for a dense allele code c of site k
+    int occ(int k, int i, int c) const {
+        switch (alleleCount(k)) {
+        case 1:
+            return i;
+        case 2: {
+            int zeros = (*u)(k, i, 0);
+            return c == 0 ? zeros : alleleStart[alleleOffset[k] + 1] + i - zeros;
+        }
+        default:
+            return (*u)(k, i, c);
         }
-
-        std::fill(fakeLocation.begin(), fakeLocation.end(), 0);
-        std::fill(Zdivergence.begin(), Zdivergence.end(), 0);
-        std::fill(belowZdivergence.begin(), belowZdivergence.end(), 0);
     }
 
-    end = clock();
-    this->outPanelQuerytime = ((double)(end - start)) / CLOCKS_PER_SEC;
+    // Start of symbol s (0..10) in array[k + 1]; an absent symbol starts
+    // where it would sort, M past the last allele
+    int symbolStart(int k, int s) const {
+        int c = alleleRank[k * 11 + s];
+        return c < alleleCount(k) ? alleleStart[alleleOffset[k] + c] : M;
+    }
+
+    // u(k, i, s) for a symbol s that may be absent at site k
+    int symbolOcc(int k, int i, int s) const {
+        const uint8_t* rank = &alleleRank[k * 11];
+        return rank[s + 1] != rank[s] ? occ(k, i, rank[s]) : symbolStart(k, s);
+    }
+    bool sortThresholds(const std::vector<int>& Ls, std::vector<int>& thresholds);
+    // Sweep state of one query haplotype: its virtual position in array[k], the
+    // divergence to the haplotypes above and below it, and the match block [f, g)
+    struct QuerySweep {
+        int fakeLocation = 0;
+        int Zdivergence = 0, belowZdivergence = 0;
+        int f = 0, g = 0;
+    };
+    int readQuerySite(std::istream& in, std::string& line, size_t& pos, std::streamoff& offset, int k);
+    int outPanelStreamBatch(std::ifstream& in, std::vector<std::streamoff>& offsets, int L, int qBegin,
+                            int batchSize, MatchSink& sink);
+    void locateQuery(const uint8_t* z, int a, int L, QuerySweep& sweep, PanelStarts& dZ);
+    // Starts is PanelStarts or BlockStarts (see MatchStarts.h)
+    template <typename Starts>
+    void advanceQuery(QuerySweep& sweep, int k, int querySite, int L, int a, int hapB, MatchSink& sink, Starts& dZ);
+    template <typename Starts>
+    void finishQuery(const QuerySweep& sweep, int b, int hapB, MatchSink& sink, Starts& dZ);
+    int outPanelMatchBatch(int L, int a, int b, int qBegin, MatchSink& sink);
+    // Scratch reused by every query and batch
+    std::vector<int> dZ, ftemp, gtemp;
+    void crossPanelBlock(int k, int top, int bottom, int tk, const std::vector<int>& order, const std::vector<int>& div,
+                         const std::vector<uint8_t>& code, std::vector<std::vector<int>>& lists, std::vector<std::vector<int>>& gaps,
+                         std::vector<int>& runMax, MatchSink& sink);
+};
+
+#endif // MULTIPBWT_H
 
-    out.close();
-    cout << "matches has been put into " << outPanelOutput_file << endl;
-    return 0;
-}
\ No newline at end of file